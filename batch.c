@@ -0,0 +1,164 @@
+// Throughput benchmark of the batch renderer library. Renders frames of random poses over the open cells
+// of a level, a batch at a time, and reports how many frames a second come out. Links the library alone.
+
+// For clock_gettime() and sysconf() with -std=c99.
+#define _DEFAULT_SOURCE
+
+#include "littlewolf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+typedef struct
+{
+    const char* level;
+    int generate;
+    int sprites;
+    int frames;
+    int batch;
+    int xres;
+    int yres;
+    int threads;
+    int textures;
+    int lights;
+}
+Args;
+
+// High resolution time in seconds.
+static double seconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Xorshift random numbers, seeded so that runs are repeatable.
+static unsigned draw(unsigned* const state)
+{
+    unsigned x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// Returns a random pose in an open cell of a <map>.
+static lw_pose place(const lw_map* const map, unsigned* const state)
+{
+    for(;;)
+    {
+        const int x = draw(state) % lw_width(map);
+        const int y = draw(state) % lw_height(map);
+        if(lw_solid(map, x, y))
+            continue;
+        const lw_pose pose = {
+            x + 0.25f + 0.5f * (draw(state) % 1024) / 1024.0f,
+            y + 0.25f + 0.5f * (draw(state) % 1024) / 1024.0f,
+            6.2831853f * (draw(state) % 1024) / 1024.0f,
+        };
+        return pose;
+    }
+}
+
+// Prints command line usage and exits.
+static void usage(const char* const name)
+{
+    printf("usage: %s [--map FILE | --generate N] [--sprites N] [--frames N] [--batch N] [--res WxH] [--threads N] [--textures 0|1] [--lights N]\n", name);
+    exit(1);
+}
+
+static Args parse(const int argc, char* argv[])
+{
+#ifdef _WIN32
+    const int cpus = 4;
+#else
+    const int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    Args args = { NULL, 0, 0, 10000, 64, 320, 200, cpus < 1 ? 1 : cpus, 0, 0 };
+    for(int i = 1; i < argc; i++)
+    {
+        const char* const arg = argv[i];
+        const char* const next = i + 1 < argc ? argv[i + 1] : NULL;
+        if(next == NULL)
+            usage(argv[0]);
+        if(strcmp(arg, "--map") == 0)
+            args.level = next;
+        else
+        if(strcmp(arg, "--generate") == 0)
+            args.generate = atoi(next);
+        else
+        if(strcmp(arg, "--sprites") == 0)
+            args.sprites = atoi(next);
+        else
+        if(strcmp(arg, "--frames") == 0)
+            args.frames = atoi(next);
+        else
+        if(strcmp(arg, "--batch") == 0)
+            args.batch = atoi(next);
+        else
+        if(strcmp(arg, "--res") == 0)
+        {
+            if(sscanf(next, "%dx%d", &args.xres, &args.yres) != 2)
+                usage(argv[0]);
+        }
+        else
+        if(strcmp(arg, "--threads") == 0)
+            args.threads = atoi(next);
+        else
+        if(strcmp(arg, "--textures") == 0)
+            args.textures = atoi(next) != 0;
+        else
+        if(strcmp(arg, "--lights") == 0)
+            args.lights = atoi(next);
+        else
+            usage(argv[0]);
+        i++;
+    }
+    if(args.generate < 0 || (args.generate > 0 && args.level) || args.sprites < 0 || args.frames < 1 || args.batch < 1
+    || args.xres < 1 || args.yres < 1 || args.threads < 1 || args.lights < 0)
+        usage(argv[0]);
+    return args;
+}
+
+int main(int argc, char* argv[])
+{
+    const Args args = parse(argc, argv);
+    lw_map* const map = args.generate ? lw_generate(args.generate, args.sprites) : lw_load(args.level, args.sprites);
+    lw_bake(map, args.lights);
+    lw_renderer* const renderer = lw_create(args.xres, args.yres, args.threads, args.textures);
+    lw_pose* const poses = malloc(sizeof(*poses) * args.batch);
+    uint32_t** const buffers = malloc(sizeof(*buffers) * args.batch);
+    if(poses == NULL || buffers == NULL)
+    {
+        puts("out of memory");
+        exit(1);
+    }
+    for(int i = 0; i < args.batch; i++)
+        if((buffers[i] = malloc(sizeof(**buffers) * args.xres * args.yres)) == NULL)
+        {
+            puts("out of memory");
+            exit(1);
+        }
+    unsigned state = 2463534242u;
+    double total = 0.0;
+    for(int done = 0; done < args.frames; done += args.batch)
+    {
+        const int count = args.frames - done < args.batch ? args.frames - done : args.batch;
+        // Poses are drawn outside the timed part, as a real caller would have them at hand.
+        for(int i = 0; i < count; i++)
+            poses[i] = place(map, &state);
+        const double t0 = seconds();
+        lw_render_batch(renderer, map, poses, count, buffers);
+        total += seconds() - t0;
+    }
+    printf("frames %d res %dx%d threads %d batch %d\n", args.frames, args.xres, args.yres, args.threads, args.batch);
+    printf("frames/sec %.0f frames/hour %.0f\n", args.frames / total, 3600.0 * args.frames / total);
+    // No need to free anything - gives quick exit.
+    return 0;
+}
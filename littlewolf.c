@@ -0,0 +1,2673 @@
+// The littlewolf engine: levels, ray casting, and rasterising frames across a worker pool, with no window
+// and no SDL. Builds into the static library of littlewolf.h, and is included whole by the game in main.c,
+// which puts a window, input and a game loop around it.
+
+// For madvise() and clock_gettime() with -std=c99.
+#define _DEFAULT_SOURCE
+
+#include "littlewolf.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+typedef struct
+{
+    float x;
+    float y;
+}
+Point;
+
+// A ray hit of a wall <tile> at <where>, <distance> along the ray in units of its direction.
+// The <side> is 0 for a vertical grid line and 1 for a horizontal one.
+typedef struct
+{
+    int tile;
+    int side;
+    Point where;
+    float distance;
+}
+Hit;
+
+typedef struct
+{
+    Point a;
+    Point b;
+}
+Line;
+
+typedef struct
+{
+    uint32_t* pixels;
+    int width;
+}
+Display;
+
+// An 8-bit palette indexed render target laid out like a display, <width> bytes from one column to the next.
+typedef struct
+{
+    uint8_t* pixels;
+    int width;
+}
+Canvas;
+
+// Tiles of floor and ceiling rendering, in columns and rows. A tile of rows of neighbouring columns samples
+// neighbouring map cells and texels, and writes a few runs of the display a few cache lines long each,
+// so that all it touches stays in the L1 cache until the tile is done.
+enum
+{
+    TILE_COLUMNS = 8,
+    TILE_ROWS = 64
+};
+
+// Light levels of the 8-bit palette, from full brightness to dark.
+enum
+{
+    LIGHTS = 16
+};
+
+typedef struct
+{
+    int top;
+    int bot;
+    float size;
+}
+Wall;
+
+typedef struct
+{
+    Line fov;
+    Point where;
+    Point velocity;
+    float speed;
+    float acceleration;
+    float theta;
+    float radius;
+}
+Hero;
+
+// Map layers. Each map cell stores all layers side by side so that the floor, wall and ceiling
+// lookups of neighbouring cells share a cache line. The fourth byte, which pads a cell to 32 bits,
+// holds the baked light of the cell in lit maps.
+enum
+{
+    CEILING,
+    WALLING,
+    FLORING,
+    LIGHTING,
+    LAYERS
+};
+
+// Baked lighting: the light every cell gets, and how many cells far a point light reaches.
+enum
+{
+    AMBIENT = 96,
+    SHINE = 8
+};
+
+// Maps are stored in square chunks of CHUNK by CHUNK cells.
+enum
+{
+    CHUNK_BITS = 6,
+    CHUNK = 1 << CHUNK_BITS,
+    CHUNK_CELLS = CHUNK * CHUNK,
+    // Chunks of a memory mapped map kept resident in every direction around the hero.
+    RESIDENT = 2,
+    // Coarse occupancy blocks are BLOCK by BLOCK cells, CHUNK / BLOCK blocks a side per chunk.
+    BLOCK_BITS = 3,
+    BLOCK = 1 << BLOCK_BITS
+};
+
+// Binary level file versioning and section kinds.
+enum
+{
+    VERSION = 1,
+    SECTIONS = 8,
+    PAGE = CHUNK_CELLS * LAYERS,
+    CELLS = 1,
+    BLOCKS = 2,
+    PORTALS = 3,
+    // Cell section flags: the cells hold baked light.
+    LIT = 1,
+    // Text levels are at most this many cells a side.
+    TEXT = 4096
+};
+
+static const char magic[4] = { 'L', 'W', 'L', 'V' };
+
+// A binary level file section of <size> bytes at <offset> bytes into the file, with some <flags> of its kind.
+typedef struct
+{
+    uint32_t kind;
+    uint32_t flags;
+    uint64_t offset;
+    uint64_t size;
+}
+Section;
+
+// The binary level file header. The section table lists the packed map cells, stored chunk by chunk
+// exactly as in memory, and optionally the precomputed coarse occupancy blocks and sector portals.
+// Every section starts page aligned.
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    uint32_t chunk;
+    uint32_t sections;
+    Section table[SECTIONS];
+}
+Header;
+
+// A packed grid of <width> by <height> cells stored chunk by chunk, <columns> chunks per row, so that
+// cells near each other on the map are near each other in memory no matter how wide the map is.
+// A <mapped> map is memory mapped from a level file and paged in lazily around the hero.
+// Optional coarse occupancy <blocks> hold one word per chunk, one bit per BLOCK by BLOCK cell block,
+// set when the block has any wall in it, for rays to skip empty blocks in one step.
+// Optional <portals> connect the blocks into a graph of sectors for visibility: two bytes per block,
+// the first for its east edge and the second for its north edge, with one bit per cell along the edge,
+// set when the cells on both sides of the edge are open.
+// A <lit> map holds baked light in its cells. Cells can change at runtime. The <edited> flags of a mapped map,
+// one per chunk, mark the chunks changed so far, which only live in memory and must never be dropped;
+// NULL until the first change.
+typedef struct
+{
+    uint8_t* cells;
+    int width;
+    int height;
+    int columns;
+    bool mapped;
+    bool lit;
+    uint64_t* blocks;
+    uint8_t* portals;
+    uint8_t* edited;
+}
+Map;
+
+#define PI 3.14159265f
+
+// 16.16 fixed point.
+typedef int32_t Fixed;
+
+// Fixed point map coordinates stay below 32768, so fixed point builds take maps of at most FIXED_SIDE
+// cells a side.
+enum
+{
+    FIXED_SIDE = 32767
+};
+
+typedef struct
+{
+    Fixed x;
+    Fixed y;
+}
+Fixpoint;
+
+// Floor and ceiling ray lengths per screen row, built once per resolution.
+// The <steps> are how far the ray length changes to the next row, for texture mip selection.
+// Fixed point builds keep the lengths in fixed point as well.
+typedef struct
+{
+    const float* rows;
+    const float* steps;
+#ifdef FIXED
+    const Fixed* fixed;
+#endif
+    int xres;
+    int yres;
+}
+Flats;
+
+// Texture atlas holding one square, power of two texture per tile value with its mip chain.
+// Texels are stored column-major like the rotated display, so a wall column reads its texels in order.
+// Mip <level> of a texture starts <offsets[level]> texels into the texture and is <size> >> <level> texels wide.
+typedef struct
+{
+    uint32_t* texels;
+    int offsets[16];
+    int bits;
+    int size;
+    int stride;
+    int count;
+}
+Atlas;
+
+// Raycast results of one frame column.
+typedef struct
+{
+    Point direction;
+    Hit hit;
+    Wall wall;
+}
+Ray;
+
+// A camera column ray <direction> with the ray distances between grid lines along x and y.
+typedef struct
+{
+    Point direction;
+    Point delta;
+}
+Beam;
+
+// The potential visibility horizon, in sectors in every direction around the hero.
+enum
+{
+    HORIZON = 32,
+    SIGHT = 2 * HORIZON + 1
+};
+
+// The sectors potentially visible to a camera this frame, out of the SIGHT by SIGHT sectors around the hero
+// starting at sector <x0>, <y0>. Every sector has a view <window> of camera slopes, low then high, through
+// which it is seen, empty if it is not seen. The <count> seen <sectors> are listed for the next frame
+// to forget them again; a negative count sees everything. The <queue> and <queued> flags are working memory.
+typedef struct
+{
+    float* windows;
+    int* sectors;
+    int* queue;
+    bool* queued;
+    int count;
+    int x0;
+    int y0;
+}
+Sight;
+
+// Renders the view of a hero at <xres> by <yres>. Holds the floor and ceiling row table and the
+// per column ray buffer of its resolution, and the per-frame constants of the hero it was last aimed
+// with: the <cosine> and <sine> of <theta>, the <focal> depth of the field of view, the wall size
+// <scale>, and the column <beams>, which are only rebuilt when the hero turns.
+// Rays are cast for every <interleave>th column, the rest interpolated where possible.
+// An indexed camera renders to its 8-bit <canvas> first, shading floor and ceiling rows by their <lights>.
+// A <tiled> camera renders floors and ceilings a tile of columns and rows at a time.
+// Its <sight> is looked up every frame.
+typedef struct
+{
+    Flats flats;
+    Beam* beams;
+    Ray* rays;
+    int interleave;
+    bool tiled;
+    Canvas canvas;
+    uint8_t* lights;
+    Sight sight;
+    Line fov;
+    float theta;
+    float cosine;
+    float sine;
+    float focal;
+    float scale;
+    int xres;
+    int yres;
+    bool aimed;
+}
+Camera;
+
+// Views rendered into one display at most: one, two side by side, or four on a two by two grid.
+enum
+{
+    VIEWS = 4
+};
+
+// A ball of some palette <tile> and <radius> resting on the floor.
+typedef struct
+{
+    Point where;
+    float radius;
+    int tile;
+}
+Sprite;
+
+// A sprite as seen from the camera: <depth> along the view direction, and its screen <x>, <y> center
+// and <radius>, in pixels, lit by the <glow> of its cell.
+typedef struct
+{
+    float depth;
+    float x;
+    float y;
+    float radius;
+    uint32_t pixel;
+    int tile;
+    int glow;
+}
+Billboard;
+
+// All <count> sprites of a level, and the <visible> ones seen this frame as <billboards> sorted far to near.
+// The radix sort <keys> and <scratch> are per frame working memory.
+typedef struct
+{
+    Sprite* sprites;
+    int count;
+    Billboard* billboards;
+    uint64_t* keys;
+    uint64_t* scratch;
+    int visible;
+}
+Sprites;
+
+// Profiled stages of a frame.
+enum
+{
+    RAYCAST,
+    FLOORS,
+    WALLS,
+    CEILINGS,
+    SPRITES,
+    CONVERT,
+    UPLOAD,
+    PRESENT,
+    STAGES
+};
+
+// A timed stage of a frame on some thread.
+typedef struct
+{
+    int stage;
+    int thread;
+    double t0;
+    double t1;
+}
+Event;
+
+// Collects stage events of a frame from all threads and writes them to a Chrome trace <file>
+// (chrome://tracing or ui.perfetto.dev). Stage totals are kept for a summary.
+typedef struct
+{
+    FILE* file;
+    Event* events;
+    int count;
+    int capacity;
+    int frames;
+    double epoch;
+    double totals[STAGES];
+}
+Profiler;
+
+// Everything a worker needs to render columns of one frame.
+// The <atlas> is NULL for flat colors, and the <profiler> is NULL when not profiling.
+typedef struct
+{
+    Hero hero;
+    Map map;
+    Display display;
+    Camera camera;
+    const uint32_t* palette;
+    const Atlas* atlas;
+    Profiler* profiler;
+    const Billboard* billboards;
+    int visible;
+}
+Frame;
+
+// A counting semaphore.
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t posted;
+    int count;
+}
+Semaphore;
+
+typedef struct Pool Pool;
+
+// A worker thread and its profiler thread id.
+typedef struct
+{
+    Pool* pool;
+    int id;
+}
+Worker;
+
+// Worker pool for rendering frame columns in parallel.
+// Columns are handed out in tiles of <width> columns through the <next> counter, taken atomically, <strips> tiles
+// to each of the <views> frames, all views sharing the one queue of tiles.
+// Every thread notes in <spans> the seconds it spent rendering the last frame.
+struct Pool
+{
+    pthread_t* threads;
+    Worker* worker;
+    double* spans;
+    Semaphore* go;
+    Semaphore* finished;
+    int next;
+    Frame frames[VIEWS];
+    int views;
+    int workers;
+    int width;
+    int strips;
+    int tiles;
+};
+
+// Rotates a point by the angle of some precomputed cosine <c> and sine <s>.
+static Point orient(const Point a, const float c, const float s)
+{
+    const Point b = { a.x * c - a.y * s, a.x * s + a.y * c };
+    return b;
+}
+
+// Subtracts two points.
+static Point sub(const Point a, const Point b)
+{
+    const Point c = { a.x - b.x, a.y - b.y };
+    return c;
+}
+
+// Adds two points.
+static Point add(const Point a, const Point b)
+{
+    const Point c = { a.x + b.x, a.y + b.y };
+    return c;
+}
+
+// Multiplies a point by a scalar value.
+static Point mul(const Point a, const float n)
+{
+    const Point b = { a.x * n, a.y * n };
+    return b;
+}
+
+// Returns the magnitude of a point.
+static float mag(const Point a)
+{
+    return sqrtf(a.x * a.x + a.y * a.y);
+}
+
+// Fast floor (math.h is too slow).
+static int fl(const float x)
+{
+    return (int) x - (x < (int) x);
+}
+
+// Returns the layers of the map cell at <x>, <y>. Anything outside the map reads as solid wall.
+// The chunk of a cell is found with address arithmetic alone, so lookups into a memory mapped map
+// are no slower than lookups into one built in memory.
+static const uint8_t* cell(const Map map, const int x, const int y)
+{
+    static const uint8_t border[LAYERS] = { 1, 1, 1, 0 };
+    if((unsigned) x >= (unsigned) map.width || (unsigned) y >= (unsigned) map.height)
+        return border;
+    const size_t chunk = (size_t) (y >> CHUNK_BITS) * map.columns + (x >> CHUNK_BITS);
+    const size_t inner = (y & (CHUNK - 1)) << CHUNK_BITS | (x & (CHUNK - 1));
+    return map.cells + LAYERS * (chunk * CHUNK_CELLS + inner);
+}
+
+// Returns the size in bytes of the cells of a map.
+static size_t extent(const Map map)
+{
+    const size_t rows = (map.height + CHUNK - 1) / CHUNK;
+    return rows * map.columns * CHUNK_CELLS * LAYERS;
+}
+
+// Returns the baked light of a cell's <layers> as a brightness from 1 to 256, full for cells of an unlit <map>.
+static int glow(const Map map, const uint8_t* const layers)
+{
+    return map.lit ? layers[LIGHTING] + 1 : 256;
+}
+
+// Returns the bit of the cell at <x>, <y>, which must be on the map, in the occupancy word of its chunk.
+static uint64_t bit(const int x, const int y)
+{
+    const int bx = (x & (CHUNK - 1)) >> BLOCK_BITS;
+    const int by = (y & (CHUNK - 1)) >> BLOCK_BITS;
+    return (uint64_t) 1 << (by << (CHUNK_BITS - BLOCK_BITS) | bx);
+}
+
+// Returns true if the coarse block holding the cell at <x>, <y> is known to have no walls.
+static bool clear(const Map map, const int x, const int y)
+{
+    if(map.blocks == NULL || (unsigned) x >= (unsigned) map.width || (unsigned) y >= (unsigned) map.height)
+        return false;
+    const size_t chunk = (size_t) (y >> CHUNK_BITS) * map.columns + (x >> CHUNK_BITS);
+    return (map.blocks[chunk] & bit(x, y)) == 0;
+}
+
+// Returns the number of sectors a row of the chunks of a map is across. Sectors are blocks.
+static int across(const Map map)
+{
+    return map.columns << (CHUNK_BITS - BLOCK_BITS);
+}
+
+// Clamps a cell coordinate <a> to the block starting at <a0>, against rounding error at block corners.
+static int inside(const int a, const int a0)
+{
+    return a < a0 ? a0 : a > a0 + BLOCK - 1 ? a0 + BLOCK - 1 : a;
+}
+
+#ifndef FIXED
+
+// Casts a <beam> from <where> until a wall tile of the <map> is hit.
+// Walks the grid one square at a time (DDA) so that no square is skipped by floating point error,
+// except for blocks the map marks empty, which are crossed whole.
+static Hit cast(const Point where, const Beam beam, const Map map)
+{
+    // Ray distance, in units of the beam direction, between two vertical (dx) or horizontal (dy) grid lines.
+    const float dx = beam.delta.x;
+    const float dy = beam.delta.y;
+    const int stepx = beam.direction.x > 0.0f ? 1 : -1;
+    const int stepy = beam.direction.y > 0.0f ? 1 : -1;
+    int x = fl(where.x);
+    int y = fl(where.y);
+    // Ray distance to the next vertical (sx) or horizontal (sy) grid line.
+    float sx = (beam.direction.x > 0.0f ? x + 1.0f - where.x : where.x - x) * dx;
+    float sy = (beam.direction.y > 0.0f ? y + 1.0f - where.y : where.y - y) * dy;
+    // The block last looked up and whether it is empty.
+    int bx = x;
+    int by = y;
+    bool empty = clear(map, x, y);
+    for(;;)
+    {
+        float t;
+        int side;
+        if(empty)
+        {
+            // Crosses the rest of an empty block in one step: finds the ray distance to the block boundary
+            // on either axis, moves to the cell just past the nearer one from the exact ray position there,
+            // and restarts the grid line distances from that cell so no error builds up over long rays.
+            const int x0 = x & ~(BLOCK - 1);
+            const int y0 = y & ~(BLOCK - 1);
+            const float tx = sx + (stepx > 0 ? x0 + BLOCK - 1 - x : x - x0) * dx;
+            const float ty = sy + (stepy > 0 ? y0 + BLOCK - 1 - y : y - y0) * dy;
+            if(tx < ty)
+            {
+                t = tx;
+                x = stepx > 0 ? x0 + BLOCK : x0 - 1;
+                y = inside(fl(where.y + beam.direction.y * t), y0);
+                side = 0;
+            }
+            else
+            {
+                t = ty;
+                y = stepy > 0 ? y0 + BLOCK : y0 - 1;
+                x = inside(fl(where.x + beam.direction.x * t), x0);
+                side = 1;
+            }
+            sx = (beam.direction.x > 0.0f ? x + 1.0f - where.x : where.x - x) * dx;
+            sy = (beam.direction.y > 0.0f ? y + 1.0f - where.y : where.y - y) * dy;
+        }
+        else
+        if(sx < sy)
+        {
+            t = sx;
+            sx += dx;
+            x += stepx;
+            side = 0;
+        }
+        else
+        {
+            t = sy;
+            sy += dy;
+            y += stepy;
+            side = 1;
+        }
+        if(((x ^ bx) | (y ^ by)) >> BLOCK_BITS)
+        {
+            bx = x;
+            by = y;
+            empty = clear(map, x, y);
+        }
+        // Cells of empty blocks need no look up.
+        const int tile = empty ? 0 : cell(map, x, y)[WALLING];
+        if(tile)
+        {
+            const Hit hit = { tile, side, add(where, mul(beam.direction, t)), t };
+            return hit;
+        }
+    }
+}
+
+#endif
+
+// Party casting. Builds the table of ray lengths, in units of a column ray direction, from the hero
+// to the floor or ceiling for every row of a screen <yres> high. A floor or ceiling point is then
+// one multiply and add away from the hero (floor adds, ceiling subtracts), independent of the wall size.
+static Flats flats(const int xres, const int yres)
+{
+    float* const rows = malloc(sizeof(*rows) * yres);
+    float* const steps = malloc(sizeof(*steps) * yres);
+    if(rows == NULL || steps == NULL)
+    {
+        puts("out of memory");
+        exit(1);
+    }
+    for(int y = 0; y < yres; y++)
+    {
+        // The horizon row, where the distance goes to infinity, is always covered by a wall.
+        const int horizon = yres - 2 * (y + 1);
+        rows[y] = 0.5f * xres / (horizon == 0 ? 1 : horizon);
+    }
+    for(int y = 0; y < yres; y++)
+    {
+        // Rows step away from the screen edge they are closest to.
+        const int next = y < yres / 2 ? y + 1 : y - 1;
+        steps[y] = next < 0 || next >= yres ? 0.0f : fabsf(rows[next] - rows[y]);
+    }
+#ifdef FIXED
+    Fixed* const fixed = malloc(sizeof(*fixed) * yres);
+    if(fixed == NULL)
+    {
+        puts("out of memory");
+        exit(1);
+    }
+    for(int y = 0; y < yres; y++)
+        fixed[y] = rows[y] * 65536.0f;
+    const Flats f = { rows, steps, fixed, xres, yres };
+#else
+    const Flats f = { rows, steps, xres, yres };
+#endif
+    return f;
+}
+
+// Linear interpolation.
+static Point lerp(const Line l, const float n)
+{
+    return add(l.a, mul(sub(l.b, l.a), n));
+}
+
+// Allocates a cache line aligned 8-bit canvas of <xres> by <yres> pixels, columns a whole number of cache lines apart.
+static Canvas canvas(const int xres, const int yres)
+{
+    const int width = (yres + 63) / 64 * 64;
+    uint8_t* const memory = malloc((size_t) width * xres + 64);
+    if(memory == NULL)
+    {
+        puts("out of memory");
+        exit(1);
+    }
+    const Canvas canvas = { memory + (64 - (uintptr_t) memory % 64), width };
+    return canvas;
+}
+
+// Scales the channels of a <pixel> by <n> / 256.
+static uint32_t scale(const uint32_t pixel, const int n)
+{
+    const uint32_t rb = (pixel & 0x00FF00FF) * n >> 8 & 0x00FF00FF;
+    const uint32_t g = (pixel & 0x0000FF00) * n >> 8 & 0x0000FF00;
+    return rb | g;
+}
+
+// Fills rows <y0> to <y1> of column <x> of gpu video memory with one <pixel>.
+static void fill(const Display display, const int x, const int y0, const int y1, const uint32_t pixel)
+{
+    uint32_t* const column = display.pixels + x * display.width;
+    int y = y0;
+#if defined(__AVX2__)
+    const __m256i v = _mm256_set1_epi32(pixel);
+    for(; y + 8 <= y1; y += 8)
+        _mm256_storeu_si256((__m256i*) (column + y), v);
+#elif defined(__SSE2__)
+    const __m128i v = _mm_set1_epi32(pixel);
+    for(; y + 4 <= y1; y += 4)
+        _mm_storeu_si128((__m128i*) (column + y), v);
+#elif defined(__ARM_NEON)
+    const uint32x4_t v = vdupq_n_u32(pixel);
+    for(; y + 4 <= y1; y += 4)
+        vst1q_u32(column + y, v);
+#endif
+    for(; y < y1; y++)
+        column[y] = pixel;
+}
+
+#ifndef FIXED
+
+// Fills rows <y0> to <y1> of column <x> of gpu video memory with the colors of a map <layer>
+// sampled at <where> plus <direction> scaled by the per-row <rows> lengths, lit by the cells they sample.
+static void span(const Display display, const int x, const int y0, const int y1,
+    const Point where, const Point direction, const float* const rows,
+    const Map map, const int layer, const uint32_t* const palette)
+{
+    uint32_t* const column = display.pixels + x * display.width;
+    int y = y0;
+#if defined(__AVX2__)
+    // Eight rows at a time: the map cells are gathered as 32 bit words and the tile byte of the
+    // layer is shifted out, then the colors are gathered from the palette. Cells are indexed in signed
+    // 32 bit lanes, so maps of more cells than those hold are left to the scalar loop.
+    const bool gathers = extent(map) / LAYERS <= INT32_MAX;
+    const __m256 wx = _mm256_set1_ps(where.x);
+    const __m256 wy = _mm256_set1_ps(where.y);
+    const __m256 dx = _mm256_set1_ps(direction.x);
+    const __m256 dy = _mm256_set1_ps(direction.y);
+    const __m256i width = _mm256_set1_epi32(map.width);
+    const __m256i height = _mm256_set1_epi32(map.height);
+    const __m256i columns = _mm256_set1_epi32(map.columns);
+    const __m256i inner = _mm256_set1_epi32(CHUNK - 1);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i border = _mm256_set1_epi32(0x00010101);
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i rb = _mm256_set1_epi32(0x00FF00FF);
+    const __m256i g = _mm256_set1_epi32(0x0000FF00);
+    for(; gathers && y + 8 <= y1; y += 8)
+    {
+        const __m256 r = _mm256_loadu_ps(rows + y);
+        const __m256i cx = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(wx, _mm256_mul_ps(dx, r))));
+        const __m256i cy = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(wy, _mm256_mul_ps(dy, r))));
+        // Same bounds check as cell(): in bounds when 0 <= c < size.
+        const __m256i inside = _mm256_andnot_si256(
+            _mm256_or_si256(_mm256_cmpgt_epi32(zero, cx), _mm256_cmpgt_epi32(zero, cy)),
+            _mm256_and_si256(_mm256_cmpgt_epi32(width, cx), _mm256_cmpgt_epi32(height, cy)));
+        // Same chunked cell index as cell().
+        const __m256i chunk = _mm256_add_epi32(
+            _mm256_srli_epi32(cx, CHUNK_BITS),
+            _mm256_mullo_epi32(_mm256_srli_epi32(cy, CHUNK_BITS), columns));
+        const __m256i index = _mm256_or_si256(
+            _mm256_slli_epi32(chunk, 2 * CHUNK_BITS),
+            _mm256_or_si256(
+                _mm256_slli_epi32(_mm256_and_si256(cy, inner), CHUNK_BITS),
+                _mm256_and_si256(cx, inner)));
+        const __m256i cells = _mm256_mask_i32gather_epi32(border, (const int*) map.cells, index, inside, LAYERS);
+        const __m256i tiles = _mm256_and_si256(_mm256_srli_epi32(cells, 8 * layer), mask);
+        __m256i colors = _mm256_i32gather_epi32((const int*) palette, tiles, 4);
+        // The light byte is the top byte of the gathered cells, and scales the colors like scale().
+        if(map.lit)
+        {
+            const __m256i n = _mm256_add_epi32(_mm256_srli_epi32(cells, 8 * LIGHTING), one);
+            colors = _mm256_or_si256(
+                _mm256_and_si256(_mm256_srli_epi32(_mm256_mullo_epi32(_mm256_and_si256(colors, rb), n), 8), rb),
+                _mm256_and_si256(_mm256_srli_epi32(_mm256_mullo_epi32(_mm256_and_si256(colors, g), n), 8), g));
+        }
+        _mm256_storeu_si256((__m256i*) (column + y), colors);
+    }
+#endif
+    for(; y < y1; y++)
+    {
+        const Point p = add(where, mul(direction, rows[y]));
+        const uint8_t* const c = cell(map, fl(p.x), fl(p.y));
+        column[y] = map.lit ? scale(palette[c[layer]], c[LIGHTING] + 1) : palette[c[layer]];
+    }
+}
+
+#endif
+
+// Returns a color value (RGB) from a decimal tile value.
+static uint32_t color(const int tile)
+{
+    switch(tile)
+    {
+    default:
+    case 1: return 0x00AA0000; // Red.
+    case 2: return 0x0000AA00; // Green.
+    case 3: return 0x000000AA; // Blue.
+    case 4: return 0x00AAAA00; // Yellow.
+    case 5: return 0x00AA00AA; // Magenta.
+    }
+}
+
+// Returns the colors of all tile values as a table for the span fillers.
+// Built on the first call which must happen before any worker starts.
+static const uint32_t* palette()
+{
+    static uint32_t colors[256];
+    static bool built;
+    if(!built)
+        for(int i = 0; i < 256; i++)
+            colors[i] = color(i);
+    built = true;
+    return colors;
+}
+
+// Returns the 8-bit palette. Index <light> * LIGHTS + <tile> holds the color of a tile dimmed to some light level.
+static const uint32_t* spectrum()
+{
+    static uint32_t colors[256];
+    static bool built;
+    if(!built)
+        for(int i = 0; i < 256; i++)
+            colors[i] = scale(color(i % LIGHTS), 256 - 14 * (i / LIGHTS));
+    built = true;
+    return colors;
+}
+
+// Returns the colormap: the 8-bit palette index of some <tile> at some <light> level is found at <light> * 256 + <tile>.
+// Tiles past the palette wrap around.
+static const uint8_t* colormap()
+{
+    static uint8_t indices[LIGHTS * 256];
+    static bool built;
+    if(!built)
+        for(int i = 0; i < LIGHTS * 256; i++)
+            indices[i] = i / 256 * LIGHTS + i % LIGHTS;
+    built = true;
+    return indices;
+}
+
+// Returns the light level at some camera <depth>. Light falls off with distance.
+static int light(const float depth)
+{
+    const float level = depth * 1.5f;
+    return level < 0.0f ? 0 : level >= LIGHTS - 1 ? LIGHTS - 1 : (int) level;
+}
+
+// Returns a light <level> darkened further by some cell <glow>, as a light level of the 8-bit palette.
+static int darken(const int level, const int glow)
+{
+    const int darker = level + (256 - glow) * LIGHTS / 256;
+    return darker > LIGHTS - 1 ? LIGHTS - 1 : darker;
+}
+
+// Averages the channels of four pixels.
+static uint32_t average(const uint32_t a, const uint32_t b, const uint32_t c, const uint32_t d)
+{
+    const uint32_t rb = ((a & 0x00FF00FF) + (b & 0x00FF00FF) + (c & 0x00FF00FF) + (d & 0x00FF00FF)) >> 2 & 0x00FF00FF;
+    const uint32_t g = ((a & 0x0000FF00) + (b & 0x0000FF00) + (c & 0x0000FF00) + (d & 0x0000FF00)) >> 2 & 0x0000FF00;
+    return rb | g;
+}
+
+// Integer hash for texture grain.
+static uint32_t noise(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7FEB352D;
+    x ^= x >> 15;
+    x *= 0x846CA68B;
+    x ^= x >> 16;
+    return x;
+}
+
+// Returns texel <u>, <v> of the generated texture of a <tile> <size> texels wide.
+// Red tiles are bricks, green tiles are square tiles, and blue tiles are rough stone.
+static uint32_t pattern(const int tile, const int u, const int v, const int size)
+{
+    const int grain = noise(tile * size * size + u * size + v) & 0x1F;
+    const int brick = size / 4;
+    const int row = v / (brick / 2);
+    const bool mortar = tile % 3 == 1
+        ? v % (brick / 2) == 0 || (u + (row % 2) * brick / 2) % brick == 0
+        : tile % 3 == 2
+        ? u % (size / 2) == 0 || v % (size / 2) == 0
+        : false;
+    const int stone = tile % 3 == 0 ? (noise(tile + (u / brick) * 31 + (v / brick) * 17) & 0x3F) : 0;
+    return scale(color(tile), mortar ? 96 : 224 + grain - stone);
+}
+
+// Generates the texture atlas of <count> (a power of two) tile textures 2 ^ <bits> texels wide.
+static Atlas atlas(const int count, const int bits)
+{
+    Atlas a;
+    memset(&a, 0, sizeof(a));
+    a.bits = bits;
+    a.size = 1 << bits;
+    a.count = count;
+    for(int level = 0; level <= bits; level++)
+    {
+        a.offsets[level] = a.stride;
+        a.stride += (a.size >> level) * (a.size >> level);
+    }
+    a.texels = malloc(sizeof(*a.texels) * a.stride * count);
+    if(a.texels == NULL)
+    {
+        puts("out of memory");
+        exit(1);
+    }
+    for(int t = 0; t < count; t++)
+    {
+        uint32_t* const texture = a.texels + t * a.stride;
+        for(int u = 0; u < a.size; u++)
+        for(int v = 0; v < a.size; v++)
+            texture[u * a.size + v] = pattern(t, u, v, a.size);
+        // Each mip level box filters the one before it.
+        for(int level = 1; level <= bits; level++)
+        {
+            const int size = a.size >> level;
+            const uint32_t* const src = texture + a.offsets[level - 1];
+            uint32_t* const dst = texture + a.offsets[level];
+            for(int u = 0; u < size; u++)
+            for(int v = 0; v < size; v++)
+                dst[u * size + v] = average(
+                    src[(2 * u + 0) * 2 * size + 2 * v + 0], src[(2 * u + 0) * 2 * size + 2 * v + 1],
+                    src[(2 * u + 1) * 2 * size + 2 * v + 0], src[(2 * u + 1) * 2 * size + 2 * v + 1]);
+        }
+    }
+    return a;
+}
+
+// Returns mip <level> of the texture of a <tile>.
+static const uint32_t* texture(const Atlas* const atlas, const int tile, const int level)
+{
+    return atlas->texels + (tile & (atlas->count - 1)) * atlas->stride + atlas->offsets[level];
+}
+
+// Floor of the base 2 logarithm of a positive float, read straight from its exponent.
+static int lg(const float x)
+{
+    union { float f; uint32_t i; } bits = { x };
+    return (int) (bits.i >> 23 & 0xFF) - 127;
+}
+
+// Clamps a mip level to the levels of an <atlas>.
+static int clamp(const Atlas* const atlas, const int level)
+{
+    return level < 0 ? 0 : level > atlas->bits ? atlas->bits : level;
+}
+
+// Fills the <wall> span of column <x> of gpu video memory with the texture of a <hit>, lit by some <glow>.
+// The texture column comes from where the hit is along the wall face, and the mip level from the wall size.
+// Texels are then stepped in 16.16 fixed point down the texture column.
+static void wallpaper(const Display display, const int x, const int yres, const Wall wall, const Hit hit,
+    const Point direction, const Atlas* const atlas, const int glow)
+{
+    const float along = hit.side == 0 ? hit.where.y : hit.where.x;
+    // Faces seen from the negative side are mirrored so textures read the same way around.
+    const float facing = hit.side == 0 ? direction.x : -direction.y;
+    const float fraction = facing > 0.0f ? along - fl(along) : 1.0f - (along - fl(along));
+    const int level = clamp(atlas, lg(atlas->size / wall.size));
+    const int size = atlas->size >> level;
+    const int u = (int) (fraction * size) & (size - 1);
+    const uint32_t* const texels = texture(atlas, hit.tile, level) + u * size;
+    const int step = size * 65536.0f / wall.size;
+    int v = (wall.bot - 0.5f * (yres - wall.size)) * step;
+    uint32_t* const column = display.pixels + x * display.width;
+    // Fully lit columns skip the multiply.
+    if(glow == 256)
+        for(int y = wall.bot; y < wall.top; y++, v += step)
+            column[y] = texels[(v >> 16) & (size - 1)];
+    else
+        for(int y = wall.bot; y < wall.top; y++, v += step)
+            column[y] = scale(texels[(v >> 16) & (size - 1)], glow);
+}
+
+// Fills rows <y0> to <y1> of column <x> of gpu video memory with the textures of a map <layer>
+// sampled at <where> plus <direction> scaled by the per-row <flats> lengths, lit by the cells they sample.
+// The mip level comes from how far apart in the world neighbouring rows sample.
+static void carpet(const Display display, const int x, const int y0, const int y1,
+    const Point where, const Point direction, const Flats flats,
+    const Map map, const int layer, const Atlas* const atlas)
+{
+    uint32_t* const column = display.pixels + x * display.width;
+    const float footprint = mag(direction) * atlas->size;
+    for(int y = y0; y < y1; y++)
+    {
+        const Point p = add(where, mul(direction, flats.rows[y]));
+        const int cx = fl(p.x);
+        const int cy = fl(p.y);
+        const int level = clamp(atlas, lg(flats.steps[y] * footprint));
+        const int size = atlas->size >> level;
+        const int u = (int) ((p.x - cx) * size) & (size - 1);
+        const int v = (int) ((p.y - cy) * size) & (size - 1);
+        const uint8_t* const c = cell(map, cx, cy);
+        const uint32_t texel = texture(atlas, c[layer], level)[u * size + v];
+        column[y] = map.lit ? scale(texel, c[LIGHTING] + 1) : texel;
+    }
+}
+
+#ifdef FIXED
+
+// The fixed point path. Built with make FIXED=1 for boards without a fast FPU.
+// The raycast, wall projection and flat colored floor and ceiling walk use integer math only.
+
+// Converts a float to fixed point.
+static Fixed fx(const float x)
+{
+    return x * 65536.0f;
+}
+
+// Converts a point to fixed point.
+static Fixpoint fixpoint(const Point a)
+{
+    const Fixpoint b = { fx(a.x), fx(a.y) };
+    return b;
+}
+
+// Converts a fixed point point back to float.
+static Point unfix(const Fixpoint a)
+{
+    const Point b = { a.x / 65536.0f, a.y / 65536.0f };
+    return b;
+}
+
+// Fixed point multiply.
+static Fixed fmul(const Fixed a, const Fixed b)
+{
+    return (int64_t) a * b >> 16;
+}
+
+// Sine table of one full turn in 4096 steps. Built on the first call which must happen before any worker starts.
+static const Fixed* sines()
+{
+    static Fixed table[4096];
+    static bool built;
+    if(!built)
+        for(int i = 0; i < 4096; i++)
+            table[i] = fx(sinf(2.0f * PI * i / 4096.0f));
+    built = true;
+    return table;
+}
+
+// Rotates a fixed point point by <theta> radians, discretised to the sine table.
+static Fixpoint fturn(const Fixpoint a, const float theta)
+{
+    const Fixed* const table = sines();
+    const int i = (int) (theta * (4096.0f / (2.0f * PI))) & 4095;
+    const Fixed s = table[i];
+    const Fixed c = table[(i + 1024) & 4095];
+    const Fixpoint b = { fmul(a.x, c) - fmul(a.y, s), fmul(a.x, s) + fmul(a.y, c) };
+    return b;
+}
+
+// Casts a ray like cast() in fixed point, also returning the ray <distance> in units of <direction>.
+static Hit fcast(const Fixpoint where, const Fixpoint direction, const Map map, Fixed* const distance)
+{
+    // Step distances are 16.16 but kept in 64 bits as rays near the grid axes have huge ones.
+    const int64_t dx = direction.x == 0 ? INT32_MAX : ((int64_t) 1 << 32) / llabs(direction.x);
+    const int64_t dy = direction.y == 0 ? INT32_MAX : ((int64_t) 1 << 32) / llabs(direction.y);
+    const int stepx = direction.x > 0 ? 1 : -1;
+    const int stepy = direction.y > 0 ? 1 : -1;
+    int x = where.x >> 16;
+    int y = where.y >> 16;
+    int64_t sx = (direction.x > 0 ? ((x + 1) << 16) - where.x : where.x - (x << 16)) * dx >> 16;
+    int64_t sy = (direction.y > 0 ? ((y + 1) << 16) - where.y : where.y - (y << 16)) * dy >> 16;
+    int bx = x;
+    int by = y;
+    bool empty = clear(map, x, y);
+    for(;;)
+    {
+        int64_t t;
+        int side;
+        if(empty)
+        {
+            // Crosses the rest of an empty block in one step like cast().
+            const int x0 = x & ~(BLOCK - 1);
+            const int y0 = y & ~(BLOCK - 1);
+            const int64_t tx = sx + (stepx > 0 ? x0 + BLOCK - 1 - x : x - x0) * dx;
+            const int64_t ty = sy + (stepy > 0 ? y0 + BLOCK - 1 - y : y - y0) * dy;
+            if(tx < ty)
+            {
+                t = tx;
+                x = stepx > 0 ? x0 + BLOCK : x0 - 1;
+                y = inside((where.y + (direction.y * t >> 16)) >> 16, y0);
+                side = 0;
+            }
+            else
+            {
+                t = ty;
+                y = stepy > 0 ? y0 + BLOCK : y0 - 1;
+                x = inside((where.x + (direction.x * t >> 16)) >> 16, x0);
+                side = 1;
+            }
+            sx = (direction.x > 0 ? ((int64_t) (x + 1) << 16) - where.x : where.x - ((int64_t) x << 16)) * dx >> 16;
+            sy = (direction.y > 0 ? ((int64_t) (y + 1) << 16) - where.y : where.y - ((int64_t) y << 16)) * dy >> 16;
+        }
+        else
+        if(sx < sy)
+        {
+            t = sx;
+            sx += dx;
+            x += stepx;
+            side = 0;
+        }
+        else
+        {
+            t = sy;
+            sy += dy;
+            y += stepy;
+            side = 1;
+        }
+        if(((x ^ bx) | (y ^ by)) >> BLOCK_BITS)
+        {
+            bx = x;
+            by = y;
+            empty = clear(map, x, y);
+        }
+        const int tile = empty ? 0 : cell(map, x, y)[WALLING];
+        if(tile)
+        {
+            *distance = t > INT32_MAX ? INT32_MAX : (Fixed) t;
+            const Fixpoint at = {
+                (Fixed) (where.x + (direction.x * t >> 16)),
+                (Fixed) (where.y + (direction.y * t >> 16)),
+            };
+            const Hit hit = { tile, side, unfix(at), t / 65536.0f };
+            return hit;
+        }
+    }
+}
+
+// Calculates wall size like project() in fixed point from the ray <distance> of a ray
+// whose direction is <focal> deep in camera space.
+static Wall fproject(const int xres, const int yres, const Fixed focal, const Fixed distance)
+{
+    const Fixed normal = fmul(distance, focal);
+    const Fixed clamped = normal < fx(1e-2f) ? fx(1e-2f) : normal;
+    const int64_t size = ((int64_t) focal * xres << 15) / clamped;
+    const int top = (((int64_t) yres << 16) + size) >> 17;
+    const int bot = (((int64_t) yres << 16) - size) >> 17;
+    const Wall wall = { top > yres ? yres : top, bot < 0 ? 0 : bot, size / 65536.0f };
+    return wall;
+}
+
+// Fills a flat colored floor or ceiling span like span() in fixed point.
+static void fspan(const Display display, const int x, const int y0, const int y1,
+    const Fixpoint where, const Fixpoint direction, const Fixed* const rows,
+    const Map map, const int layer, const uint32_t* const palette)
+{
+    uint32_t* const column = display.pixels + x * display.width;
+    for(int y = y0; y < y1; y++)
+    {
+        const int cx = (where.x + fmul(direction.x, rows[y])) >> 16;
+        const int cy = (where.y + fmul(direction.y, rows[y])) >> 16;
+        const uint8_t* const c = cell(map, cx, cy);
+        column[y] = map.lit ? scale(palette[c[layer]], c[LIGHTING] + 1) : palette[c[layer]];
+    }
+}
+
+#endif
+
+#ifndef FIXED
+
+// Calculations wall size of a <camera> column ray hitting a wall <distance> along the ray.
+static Wall project(const Camera camera, const float distance)
+{
+    // Column rays are one focal length deep in camera space, so the normal distance to the wall is
+    // the ray distance times the focal length. It is clamped to some small value else wall size
+    // will shoot to infinity.
+    const float depth = distance * camera.focal;
+    const float normal = depth < 1e-2f ? 1e-2f : depth;
+    const float size = camera.scale / normal;
+    const int yres = camera.yres;
+    const int top = (yres + size) / 2.0f;
+    const int bot = (yres - size) / 2.0f;
+    // Top and bottom values are clamped to screen size else renderer will waste cycles
+    // (or segfault) when rasterizing pixels off screen.
+    const Wall wall = { top > yres ? yres : top, bot < 0 ? 0 : bot, size };
+    return wall;
+}
+
+#endif
+
+// High resolution time in seconds.
+static double seconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Ends a stage started at <t0> on a <thread>, returning the start time of the next stage.
+// Thread safe. Does nothing without a <profiler>.
+static double lap(Profiler* const profiler, const int stage, const int thread, const double t0)
+{
+    if(profiler == NULL)
+        return 0.0;
+    const double t1 = seconds();
+    const int i = __atomic_fetch_add(&profiler->count, 1, __ATOMIC_RELAXED);
+    if(i < profiler->capacity)
+    {
+        const Event event = { stage, thread, t0, t1 };
+        profiler->events[i] = event;
+    }
+    return t1;
+}
+
+// Returns a timestamp to start the first stage with. Zero without a <profiler>.
+static double stamp(Profiler* const profiler)
+{
+    return profiler ? seconds() : 0.0;
+}
+
+// Sorts <count> <keys> by their upper 32 bits, a byte at a time, through some <scratch> space as large.
+// An even number of passes leaves the sorted keys back in <keys>.
+static void radix(uint64_t* keys, uint64_t* scratch, const int count)
+{
+    for(int shift = 32; shift < 64; shift += 8)
+    {
+        int offsets[257] = { 0 };
+        for(int i = 0; i < count; i++)
+            offsets[(keys[i] >> shift & 0xFF) + 1]++;
+        for(int i = 0; i < 256; i++)
+            offsets[i + 1] += offsets[i];
+        for(int i = 0; i < count; i++)
+            scratch[offsets[keys[i] >> shift & 0xFF]++] = keys[i];
+        uint64_t* const temp = keys;
+        keys = scratch;
+        scratch = temp;
+    }
+}
+
+// Returns true if the map cell at <x>, <y> is potentially visible to a <camera>.
+static bool seen(const Camera camera, const int x, const int y)
+{
+    const Sight sight = camera.sight;
+    if(sight.count < 0)
+        return true;
+    const int sx = (x >> BLOCK_BITS) - sight.x0;
+    const int sy = (y >> BLOCK_BITS) - sight.y0;
+    if((unsigned) sx >= SIGHT || (unsigned) sy >= SIGHT)
+        return false;
+    const float* const window = sight.windows + 2 * (sy * SIGHT + sx);
+    return window[0] <= window[1];
+}
+
+// Returns true if any cell a <sprite> overlaps is potentially visible to a <camera>.
+// Sprites are smaller than sectors, so the cells under the corners of their bounds are enough to look at.
+static bool sighted(const Camera camera, const Sprite sprite)
+{
+    const int x0 = fl(sprite.where.x - sprite.radius);
+    const int y0 = fl(sprite.where.y - sprite.radius);
+    const int x1 = fl(sprite.where.x + sprite.radius);
+    const int y1 = fl(sprite.where.y + sprite.radius);
+    return seen(camera, x0, y0) || seen(camera, x1, y0) || seen(camera, x0, y1) || seen(camera, x1, y1);
+}
+
+// Returns the light of the wall face a <ray> hit, which is that of the cell in front of the face.
+static int gleam(const Map map, const Ray ray)
+{
+    if(!map.lit)
+        return 256;
+    const Hit hit = ray.hit;
+    const int line = roundf(hit.side ? hit.where.y : hit.where.x);
+    const bool ahead = (hit.side ? ray.direction.y : ray.direction.x) > 0.0f;
+    const int front = ahead ? line - 1 : line;
+    return hit.side ? glow(map, cell(map, fl(hit.where.x), front)) : glow(map, cell(map, front, fl(hit.where.y)));
+}
+
+// Projects the <sprites> in view of the <camera>, sorted far to near for painting, lit by the cells they stand in.
+static Sprites depict(Sprites sprites, const Camera camera, const Hero hero, const Map map, const uint32_t* const palette)
+{
+    sprites.visible = 0;
+    for(int i = 0; i < sprites.count; i++)
+    {
+        const Sprite sprite = sprites.sprites[i];
+        const Point where = sub(sprite.where, hero.where);
+        const float depth = where.x * camera.cosine + where.y * camera.sine;
+        const float side = where.y * camera.cosine - where.x * camera.sine;
+        // Culls sprites behind the camera and outside the left and right edges of the field of view.
+        if(depth < 1e-2f)
+            continue;
+        const float x = 0.5f * camera.xres + camera.scale * side / depth;
+        const float r = sprite.radius * camera.scale / depth;
+        if(x + r < 0.0f || x - r > camera.xres)
+            continue;
+        // Culls sprites in sectors that cannot be seen.
+        if(!sighted(camera, sprite))
+            continue;
+        // Positive floats sort like their bits, so inverted depth bits sort far to near.
+        uint32_t bits;
+        memcpy(&bits, &depth, sizeof(bits));
+        sprites.keys[sprites.visible++] = (uint64_t) ~bits << 32 | i;
+    }
+    radix(sprites.keys, sprites.scratch, sprites.visible);
+    for(int i = 0; i < sprites.visible; i++)
+    {
+        const Sprite sprite = sprites.sprites[(uint32_t) sprites.keys[i]];
+        const Point where = sub(sprite.where, hero.where);
+        const float depth = where.x * camera.cosine + where.y * camera.sine;
+        const float side = where.y * camera.cosine - where.x * camera.sine;
+        const float size = camera.scale / depth;
+        const int g = glow(map, cell(map, fl(sprite.where.x), fl(sprite.where.y)));
+        const Billboard billboard = {
+            depth,
+            0.5f * camera.xres + camera.scale * side / depth,
+            0.5f * camera.yres + (sprite.radius - 0.5f) * size,
+            sprite.radius * size,
+            scale(palette[sprite.tile], g),
+            sprite.tile,
+            g,
+        };
+        sprites.billboards[i] = billboard;
+    }
+    return sprites;
+}
+
+// Draws column <x> of a <billboard> ball, clipped to a screen <yres> high.
+static void ball(const Display display, const int x, const int yres, const Billboard billboard)
+{
+    const float u = (x + 0.5f - billboard.x) / billboard.radius;
+    if(u * u >= 1.0f)
+        return;
+    const float half = billboard.radius * sqrtf(1.0f - u * u);
+    const int y0 = billboard.y - half;
+    const int y1 = billboard.y + half;
+    fill(display, x, y0 < 0 ? 0 : y0, y1 > yres ? yres : y1, billboard.pixel);
+}
+
+// Writes rows <y0> to <y1> of column <x> of a <canvas> with the floor or ceiling colormap indices of a map <layer>,
+// each row shaded by its light level, darkened by the light of the cell it samples.
+static void span8(const Canvas canvas, const int x, const int y0, const int y1,
+    const Point where, const Point direction, const float* const rows, const uint8_t* const lights, const Map map, const int layer)
+{
+    const uint8_t* const shades = colormap();
+    uint8_t* const column = canvas.pixels + x * canvas.width;
+    for(int y = y0; y < y1; y++)
+    {
+        const Point p = add(where, mul(direction, rows[y]));
+        const uint8_t* const c = cell(map, fl(p.x), fl(p.y));
+        column[y] = shades[(map.lit ? darken(lights[y], c[LIGHTING] + 1) : lights[y]) * 256 + c[layer]];
+    }
+}
+
+// Draws column <x> of a <billboard> ball into a <canvas> at some colormap <index>, clipped to a screen <yres> high.
+static void ball8(const Canvas canvas, const int x, const int yres, const Billboard billboard, const uint8_t index)
+{
+    const float u = (x + 0.5f - billboard.x) / billboard.radius;
+    if(u * u >= 1.0f)
+        return;
+    const float half = billboard.radius * sqrtf(1.0f - u * u);
+    const int y0 = billboard.y - half < 0.0f ? 0 : billboard.y - half;
+    const int y1 = billboard.y + half > yres ? yres : billboard.y + half;
+    if(y1 > y0)
+        memset(canvas.pixels + x * canvas.width + y0, index, y1 - y0);
+}
+
+// Converts the first <yres> rows of column <x> of a <canvas> to true color onto a <display> through the 8-bit palette.
+static void convert(const Canvas canvas, const Display display, const int x, const int yres)
+{
+    const uint32_t* const colors = spectrum();
+    const uint8_t* const from = canvas.pixels + x * canvas.width;
+    uint32_t* const to = display.pixels + x * display.width;
+    int y = 0;
+#if defined(__AVX2__)
+    for(; y + 8 <= yres; y += 8)
+    {
+        const __m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (from + y)));
+        _mm256_storeu_si256((__m256i*) (to + y), _mm256_i32gather_epi32((const int*) colors, indices, 4));
+    }
+#endif
+    for(; y < yres; y++)
+        to[y] = colors[from[y]];
+}
+
+// Renders rows <y0> to <y1> of the floor or ceiling, a map <layer>, of column <x> of a <frame>, seen by a <ray>.
+static void flat(const Frame frame, const int x, const int y0, const int y1, const Ray ray, const int layer)
+{
+    // Ceiling rows are as far from the hero as floor rows, the other way down the ray.
+    const Point direction = layer == CEILING ? mul(ray.direction, -1.0f) : ray.direction;
+    if(frame.camera.canvas.pixels)
+        span8(frame.camera.canvas, x, y0, y1, frame.hero.where, direction, frame.camera.flats.rows, frame.camera.lights, frame.map, layer);
+    else
+    if(frame.atlas)
+        carpet(frame.display, x, y0, y1, frame.hero.where, direction, frame.camera.flats, frame.map, layer, frame.atlas);
+    else
+#ifdef FIXED
+        fspan(frame.display, x, y0, y1, fixpoint(frame.hero.where), fixpoint(direction), frame.camera.flats.fixed, frame.map, layer, frame.palette);
+#else
+        span(frame.display, x, y0, y1, frame.hero.where, direction, frame.camera.flats.rows, frame.map, layer, frame.palette);
+#endif
+}
+
+// Renders the floor or ceiling, a map <layer>, of columns <x0> to <x1> of a <frame>: column by column,
+// or with a tiled camera, TILE_ROWS rows of TILE_COLUMNS columns at a time. Either way renders the same pixels.
+static void pave(const Frame frame, const int x0, const int x1, const int layer)
+{
+    const int yres = frame.camera.yres;
+    const int columns = frame.camera.tiled ? TILE_COLUMNS : x1 - x0;
+    const int rows = frame.camera.tiled ? TILE_ROWS : yres;
+    for(int c = x0; c < x1; c += columns)
+    for(int r = 0; r < yres; r += rows)
+    for(int x = c; x < (c + columns < x1 ? c + columns : x1); x++)
+    {
+        const Ray ray = frame.camera.rays[x];
+        const int y0 = layer == CEILING && ray.wall.top > r ? ray.wall.top : r;
+        const int end = layer == CEILING ? yres : ray.wall.bot;
+        const int y1 = r + rows < end ? r + rows : end;
+        if(y0 < y1)
+            flat(frame, x, y0, y1, ray, layer);
+    }
+}
+
+// Renders columns <x0> to <x1> of a <frame> like stripe() once the rays are cast, but into the camera canvas,
+// shading by distance through the colormap, and converting to true color on the display last.
+static void shade(const Frame frame, const int x0, const int x1, const int thread, double t)
+{
+    const Camera camera = frame.camera;
+    const uint8_t* const shades = colormap();
+    // Renders flooring.
+    pave(frame, x0, x1, FLORING);
+    t = lap(frame.profiler, FLOORS, thread, t);
+    // Renders walls, one light level per column.
+    for(int x = x0; x < x1; x++)
+    {
+        const Ray ray = camera.rays[x];
+        const int level = light(ray.hit.distance * camera.focal);
+        const uint8_t index = shades[(frame.map.lit ? darken(level, gleam(frame.map, ray)) : level) * 256 + ray.hit.tile];
+        if(ray.wall.top > ray.wall.bot)
+            memset(camera.canvas.pixels + x * camera.canvas.width + ray.wall.bot, index, ray.wall.top - ray.wall.bot);
+    }
+    t = lap(frame.profiler, WALLS, thread, t);
+    // Renders ceiling.
+    pave(frame, x0, x1, CEILING);
+    t = lap(frame.profiler, CEILINGS, thread, t);
+    // Renders sprites, one light level per sprite.
+    for(int i = 0; i < frame.visible; i++)
+    {
+        const Billboard billboard = frame.billboards[i];
+        const uint8_t index = shades[darken(light(billboard.depth), billboard.glow) * 256 + billboard.tile];
+        const int left = billboard.x - billboard.radius;
+        const int right = billboard.x + billboard.radius + 1.0f;
+        for(int x = left < x0 ? x0 : left; x < (right > x1 ? x1 : right); x++)
+            if(billboard.depth < camera.rays[x].hit.distance * camera.focal)
+                ball8(camera.canvas, x, camera.yres, billboard, index);
+    }
+    t = lap(frame.profiler, SPRITES, thread, t);
+    // Converts the stripe to true color.
+    for(int x = x0; x < x1; x++)
+        convert(camera.canvas, frame.display, x, camera.yres);
+    lap(frame.profiler, CONVERT, thread, t);
+}
+
+#ifndef FIXED
+
+// Casts the ray of column <x> of a <frame>.
+static void trace(const Frame frame, const int x)
+{
+    Ray* const ray = &frame.camera.rays[x];
+    const Beam beam = frame.camera.beams[x];
+    ray->direction = beam.direction;
+    ray->hit = cast(frame.hero.where, beam, frame.map);
+    ray->wall = project(frame.camera, ray->hit.distance);
+}
+
+// Returns true if two rays <a> and <b> hit one flat face of a same tiled wall that nothing stands in front of,
+// so that every ray between them hits that face too.
+static bool planar(const Frame frame, const Ray a, const Ray b)
+{
+    if(a.hit.tile != b.hit.tile || a.hit.side != b.hit.side)
+        return false;
+    // A wall standing between the rays and touching neither would lie whole in the triangle of the hero and
+    // the two hits. A cell is a cell wide whichever way it is measured, so it cannot fit in a triangle whose
+    // narrowest width, its smallest height, is less than a cell. Only such triangles are interpolated.
+    const Point pa = sub(a.hit.where, frame.hero.where);
+    const Point pb = sub(b.hit.where, frame.hero.where);
+    // Twice the area of the triangle over its longest side is its smallest height.
+    const float twice = fabsf(pa.x * pb.y - pa.y * pb.x);
+    const float ab = mag(sub(a.hit.where, b.hit.where));
+    const float longest = fmaxf(ab, fmaxf(mag(pa), mag(pb)));
+    if(twice >= longest)
+        return false;
+    // The grid line the face is on, and the direction rays cross it in.
+    const int side = a.hit.side;
+    const float la = side ? a.hit.where.y : a.hit.where.x;
+    const float lb = side ? b.hit.where.y : b.hit.where.x;
+    const float da = side ? a.direction.y : a.direction.x;
+    const float db = side ? b.direction.y : b.direction.x;
+    const int line = roundf(la);
+    if(line != (int) roundf(lb) || (da > 0.0f) != (db > 0.0f))
+        return false;
+    const int wall = da > 0.0f ? line : line - 1;
+    const int front = da > 0.0f ? line - 1 : line;
+    // The cells along the face between the hits must all be the face, and the cells in front of them open, since
+    // those touch the face and so could reach into the triangle without filling it. They are kept to a few
+    // as a long face costs as much as casting.
+    const int ca = fl(side ? a.hit.where.x : a.hit.where.y);
+    const int cb = fl(side ? b.hit.where.x : b.hit.where.y);
+    const int c0 = ca < cb ? ca : cb;
+    const int c1 = ca < cb ? cb : ca;
+    if(c1 - c0 > 8)
+        return false;
+    for(int c = c0; c <= c1; c++)
+    {
+        const uint8_t* const w = side ? cell(frame.map, c, wall) : cell(frame.map, wall, c);
+        const uint8_t* const f = side ? cell(frame.map, c, front) : cell(frame.map, front, c);
+        if(w[WALLING] != a.hit.tile || f[WALLING] != 0)
+            return false;
+    }
+    return true;
+}
+
+// Interpolates the rays of the columns between columns <a> and <b> of a frame, which hit one flat wall face.
+// The inverse of the ray distance to a plane is linear across the screen, so it is interpolated instead of
+// the distance for perspective correct hits.
+static void between(const Frame frame, const int a, const int b)
+{
+    const Hit ha = frame.camera.rays[a].hit;
+    const Hit hb = frame.camera.rays[b].hit;
+    const float ia = 1.0f / ha.distance;
+    const float ib = 1.0f / hb.distance;
+    for(int x = a + 1; x < b; x++)
+    {
+        const float n = (x - a) / (float) (b - a);
+        const float distance = 1.0f / (ia + (ib - ia) * n);
+        Ray* const ray = &frame.camera.rays[x];
+        const Beam beam = frame.camera.beams[x];
+        const Hit hit = { ha.tile, ha.side, add(frame.hero.where, mul(beam.direction, distance)), distance };
+        ray->direction = beam.direction;
+        ray->hit = hit;
+        ray->wall = project(frame.camera, distance);
+    }
+}
+
+#endif
+
+// Renders columns <x0> to <x1> of a <frame> on some <thread>, one stage at a time.
+static void stripe(const Frame frame, const int x0, const int x1, const int thread)
+{
+    double t = stamp(frame.profiler);
+#ifdef FIXED
+    const Fixpoint where = fixpoint(frame.hero.where);
+    const Fixpoint a = fturn(fixpoint(frame.hero.fov.a), frame.hero.theta);
+    const Fixpoint b = fturn(fixpoint(frame.hero.fov.b), frame.hero.theta);
+    const Fixed focal = fx(frame.hero.fov.a.x);
+    for(int x = x0; x < x1; x++)
+    {
+        Ray* const ray = &frame.camera.rays[x];
+        const Fixpoint direction = {
+            (Fixed) (a.x + (int64_t) (b.x - a.x) * x / frame.camera.xres),
+            (Fixed) (a.y + (int64_t) (b.y - a.y) * x / frame.camera.xres),
+        };
+        Fixed distance;
+        ray->direction = unfix(direction);
+        ray->hit = fcast(where, direction, frame.map, &distance);
+        ray->wall = fproject(frame.camera.xres, frame.camera.yres, focal, distance);
+    }
+#else
+    // Casts every interleaved column and the last, and then the columns between any two of them,
+    // unless both hit one flat wall face and the columns between can be interpolated.
+    const int n = frame.camera.interleave;
+    trace(frame, x0);
+    for(int a = x0, b; a < x1 - 1; a = b)
+    {
+        b = a + n < x1 - 1 ? a + n : x1 - 1;
+        trace(frame, b);
+        if(b - a > 1 && planar(frame, frame.camera.rays[a], frame.camera.rays[b]))
+            between(frame, a, b);
+        else
+            for(int x = a + 1; x < b; x++)
+                trace(frame, x);
+    }
+#endif
+    t = lap(frame.profiler, RAYCAST, thread, t);
+    if(frame.camera.canvas.pixels)
+    {
+        shade(frame, x0, x1, thread, t);
+        return;
+    }
+    // Renders flooring.
+    pave(frame, x0, x1, FLORING);
+    t = lap(frame.profiler, FLOORS, thread, t);
+    // Renders walls.
+    for(int x = x0; x < x1; x++)
+    {
+        const Ray ray = frame.camera.rays[x];
+        const int g = gleam(frame.map, ray);
+        if(frame.atlas)
+            wallpaper(frame.display, x, frame.camera.yres, ray.wall, ray.hit, ray.direction, frame.atlas, g);
+        else
+            fill(frame.display, x, ray.wall.bot, ray.wall.top, scale(frame.palette[ray.hit.tile], g));
+    }
+    t = lap(frame.profiler, WALLS, thread, t);
+    // Renders ceiling.
+    pave(frame, x0, x1, CEILING);
+    t = lap(frame.profiler, CEILINGS, thread, t);
+    // Renders sprites far to near, column by column, wherever they are nearer than the wall.
+    // The ray distances to the walls serve as a one dimensional depth buffer.
+    for(int i = 0; i < frame.visible; i++)
+    {
+        const Billboard billboard = frame.billboards[i];
+        const int left = billboard.x - billboard.radius;
+        const int right = billboard.x + billboard.radius + 1.0f;
+        for(int x = left < x0 ? x0 : left; x < (right > x1 ? x1 : right); x++)
+            if(billboard.depth < frame.camera.rays[x].hit.distance * frame.camera.focal)
+                ball(frame.display, x, frame.camera.yres, billboard);
+    }
+    lap(frame.profiler, SPRITES, thread, t);
+}
+
+// Renders tiles of columns on some <thread> until none of the frame is left.
+static void columns(Pool* const pool, const int thread)
+{
+    const double t0 = seconds();
+    for(int i; (i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < pool->tiles;)
+    {
+        const Frame frame = pool->frames[i / pool->strips];
+        const int x0 = i % pool->strips * pool->width;
+        const int x1 = x0 + pool->width > frame.camera.xres ? frame.camera.xres : x0 + pool->width;
+        stripe(frame, x0, x1, thread);
+    }
+    pool->spans[thread] = seconds() - t0;
+}
+
+// Creates a semaphore with a zero count.
+static Semaphore* semaphore()
+{
+    Semaphore* const semaphore = malloc(sizeof(*semaphore));
+    if(semaphore == NULL || pthread_mutex_init(&semaphore->lock, NULL) != 0 || pthread_cond_init(&semaphore->posted, NULL) != 0)
+    {
+        puts("could not create a semaphore");
+        exit(1);
+    }
+    semaphore->count = 0;
+    return semaphore;
+}
+
+// Counts a <semaphore> up, waking a thread waiting on it.
+static void give(Semaphore* const semaphore)
+{
+    pthread_mutex_lock(&semaphore->lock);
+    semaphore->count++;
+    pthread_cond_signal(&semaphore->posted);
+    pthread_mutex_unlock(&semaphore->lock);
+}
+
+// Counts a <semaphore> down, first waiting for it to be counted up if it is zero.
+static void take(Semaphore* const semaphore)
+{
+    pthread_mutex_lock(&semaphore->lock);
+    while(semaphore->count == 0)
+        pthread_cond_wait(&semaphore->posted, &semaphore->lock);
+    semaphore->count--;
+    pthread_mutex_unlock(&semaphore->lock);
+}
+
+// Worker thread entry. Sleeps until a frame is handed out, renders its share, and reports back.
+static void* work(void* const data)
+{
+    const Worker* const worker = (const Worker*) data;
+    Pool* const pool = worker->pool;
+    for(;;)
+    {
+        take(pool->go);
+        columns(pool, worker->id);
+        give(pool->finished);
+    }
+    return NULL;
+}
+
+// Spawns <threads> - 1 workers. The calling thread renders alongside them.
+static Pool spawn(const int threads)
+{
+    Pool pool;
+    memset(&pool, 0, sizeof(pool));
+    pool.workers = threads < 1 ? 0 : threads - 1;
+    pool.go = semaphore();
+    pool.finished = semaphore();
+    pool.threads = malloc(sizeof(*pool.threads) * (pool.workers + 1));
+    pool.worker = malloc(sizeof(*pool.worker) * (pool.workers + 1));
+    pool.spans = calloc(pool.workers + 1, sizeof(*pool.spans));
+    if(pool.threads == NULL || pool.worker == NULL || pool.spans == NULL)
+    {
+        puts("out of memory");
+        exit(1);
+    }
+    return pool;
+}
+
+// Starts the workers. Done separately from spawn() as the workers hold the pool address.
+static void start(Pool* const pool)
+{
+    for(int i = 0; i < pool->workers; i++)
+    {
+        // The calling thread is thread 0.
+        const Worker worker = { pool, i + 1 };
+        pool->worker[i] = worker;
+        if(pthread_create(&pool->threads[i], NULL, work, &pool->worker[i]) != 0)
+        {
+            puts("could not start a worker thread");
+            exit(1);
+        }
+    }
+}
+
+// Greatest common divisor.
+static int gcd(const int a, const int b)
+{
+    return b == 0 ? a : gcd(b, a % b);
+}
+
+// Returns the tile width (in columns) for <threads> splitting <xres> columns of a <display>.
+// Display columns are <display.width> pixels apart, so the tile width is rounded to a multiple
+// of columns whose byte size is divisible by a 64 byte cache line. Two threads then never write
+// the same cache line, given the locked texture memory is itself cache line aligned.
+static int tiling(const Display display, const int xres, const int threads)
+{
+    const int line = 64 / sizeof(*display.pixels);
+    const int multiple = line / gcd(display.width, line);
+    // A few tiles per thread balances columns which are more expensive than others.
+    const int ideal = xres / (4 * threads) + 1;
+    return (ideal + multiple - 1) / multiple * multiple;
+}
+
+// Hands the columns of some <views> <frames>, all of one resolution, to the workers of the <pool> and returns right away.
+static void kick(Pool* const pool, const Frame* const frames, const int views)
+{
+    for(int i = 0; i < views; i++)
+        pool->frames[i] = frames[i];
+    pool->views = views;
+    pool->width = tiling(frames[0].display, frames[0].camera.xres, pool->workers + 1);
+    pool->strips = (frames[0].camera.xres + pool->width - 1) / pool->width;
+    pool->tiles = pool->strips * views;
+    __atomic_store_n(&pool->next, 0, __ATOMIC_RELAXED);
+    for(int i = 0; i < pool->workers; i++)
+        give(pool->go);
+}
+
+// Renders what is left of the kicked frame on the calling thread,
+// then waits for the workers to finish theirs (a barrier).
+static void join(Pool* const pool)
+{
+    columns(pool, 0);
+    for(int i = 0; i < pool->workers; i++)
+        take(pool->finished);
+}
+
+// Renders all columns of some <views> <frames> across the <pool>,
+// returning once all columns are done.
+static void raster(Pool* const pool, const Frame* const frames, const int views)
+{
+    kick(pool, frames, views);
+    join(pool);
+}
+
+// Creates a camera rendering at <xres> by <yres>, casting every <interleave>th column, <indexed> or not,
+// and <tiled> or not. It must be aimed before rendering.
+static Camera lens(const int xres, const int yres, const int interleave, const bool indexed, const bool tiled)
+{
+    Camera camera;
+    memset(&camera, 0, sizeof(camera));
+    camera.interleave = interleave;
+    camera.tiled = tiled;
+    if(indexed)
+    {
+        camera.canvas = canvas(xres, yres);
+        camera.lights = malloc(yres);
+        if(camera.lights == NULL)
+        {
+            puts("out of memory");
+            exit(1);
+        }
+    }
+    camera.flats = flats(xres, yres);
+    camera.beams = malloc(sizeof(*camera.beams) * xres);
+    camera.rays = malloc(sizeof(*camera.rays) * xres);
+    camera.xres = xres;
+    camera.yres = yres;
+    camera.sight.windows = malloc(sizeof(*camera.sight.windows) * 2 * SIGHT * SIGHT);
+    camera.sight.sectors = malloc(sizeof(*camera.sight.sectors) * SIGHT * SIGHT);
+    camera.sight.queue = malloc(sizeof(*camera.sight.queue) * SIGHT * SIGHT);
+    camera.sight.queued = calloc(SIGHT * SIGHT, sizeof(*camera.sight.queued));
+    if(camera.beams == NULL || camera.rays == NULL || camera.sight.windows == NULL
+    || camera.sight.sectors == NULL || camera.sight.queue == NULL || camera.sight.queued == NULL)
+    {
+        puts("out of memory");
+        exit(1);
+    }
+    // Nothing is seen until the camera looks.
+    for(int i = 0; i < SIGHT * SIGHT; i++)
+    {
+        camera.sight.windows[2 * i + 0] = 1.0f;
+        camera.sight.windows[2 * i + 1] = -1.0f;
+    }
+    return camera;
+}
+
+// Aims a <camera> with the view of a <hero>. The column beams are rebuilt only if the hero turned
+// or changed its field of view since the last aim.
+static Camera aim(Camera camera, const Hero hero)
+{
+    if(camera.aimed
+    && camera.theta == hero.theta
+    && camera.fov.a.x == hero.fov.a.x && camera.fov.a.y == hero.fov.a.y
+    && camera.fov.b.x == hero.fov.b.x && camera.fov.b.y == hero.fov.b.y)
+        return camera;
+    camera.aimed = true;
+    camera.theta = hero.theta;
+    camera.fov = hero.fov;
+    camera.cosine = cosf(hero.theta);
+    camera.sine = sinf(hero.theta);
+    camera.focal = hero.fov.a.x;
+    camera.scale = 0.5f * camera.focal * camera.xres;
+    const Line rotated = {
+        orient(hero.fov.a, camera.cosine, camera.sine),
+        orient(hero.fov.b, camera.cosine, camera.sine),
+    };
+    for(int x = 0; x < camera.xres; x++)
+    {
+        const Point direction = lerp(rotated, x / (float) camera.xres);
+        const Point delta = {
+            direction.x == 0.0f ? 1e30f : fabsf(1.0f / direction.x),
+            direction.y == 0.0f ? 1e30f : fabsf(1.0f / direction.y),
+        };
+        const Beam beam = { direction, delta };
+        camera.beams[x] = beam;
+    }
+    if(camera.lights)
+        for(int y = 0; y < camera.yres; y++)
+            camera.lights[y] = light(camera.flats.rows[y] * camera.focal);
+    return camera;
+}
+
+// Narrows a view <window> of camera slopes, low then high, to a portal from <a> to <b> seen from <where>
+// by an aimed <camera>. Portals reaching behind the camera keep the window whole, and portals wholly
+// behind it close it.
+static void narrow(const Camera camera, const Point where, const Point a, const Point b, float window[2])
+{
+    const Point u = sub(a, where);
+    const Point v = sub(b, where);
+    const float ud = u.x * camera.cosine + u.y * camera.sine;
+    const float vd = v.x * camera.cosine + v.y * camera.sine;
+    if(ud <= 0.0f && vd <= 0.0f)
+    {
+        window[0] = 1.0f;
+        window[1] = -1.0f;
+        return;
+    }
+    if(ud < 1e-3f || vd < 1e-3f)
+        return;
+    const float us = (u.y * camera.cosine - u.x * camera.sine) / ud;
+    const float vs = (v.y * camera.cosine - v.x * camera.sine) / vd;
+    const float lo = us < vs ? us : vs;
+    const float hi = us < vs ? vs : us;
+    window[0] = window[0] > lo ? window[0] : lo;
+    window[1] = window[1] < hi ? window[1] : hi;
+}
+
+// Finds the sectors of a <map> potentially visible to an aimed <camera> standing at <where>, out to the HORIZON.
+// Sectors are flooded breadth first from the sector of the camera through the portals of the map, every
+// portal narrowing the view window it is seen through, so that sectors around corners or behind walls
+// are never reached. Sectors reached again through a wider window are flooded again from there.
+// Without portals everything is seen.
+static Camera look(Camera camera, const Map map, const Point where)
+{
+    Sight sight = camera.sight;
+    if(map.portals == NULL)
+    {
+        sight.count = -1;
+        camera.sight = sight;
+        return camera;
+    }
+    // Forgets the last frame.
+    for(int i = 0; i < sight.count; i++)
+    {
+        sight.windows[2 * sight.sectors[i] + 0] = 1.0f;
+        sight.windows[2 * sight.sectors[i] + 1] = -1.0f;
+    }
+    sight.x0 = (fl(where.x) >> BLOCK_BITS) - HORIZON;
+    sight.y0 = (fl(where.y) >> BLOCK_BITS) - HORIZON;
+    sight.count = 0;
+    const int start = HORIZON * SIGHT + HORIZON;
+    sight.windows[2 * start + 0] = camera.fov.a.y / camera.fov.a.x - 1e-3f;
+    sight.windows[2 * start + 1] = camera.fov.b.y / camera.fov.b.x + 1e-3f;
+    sight.sectors[sight.count++] = start;
+    sight.queue[0] = start;
+    sight.queued[start] = true;
+    const int wide = (map.width + BLOCK - 1) >> BLOCK_BITS;
+    const int high = (map.height + BLOCK - 1) >> BLOCK_BITS;
+    for(int head = 0, tail = 1; head != tail; head = (head + 1) % (SIGHT * SIGHT))
+    {
+        const int s = sight.queue[head];
+        sight.queued[s] = false;
+        const int bx = sight.x0 + s % SIGHT;
+        const int by = sight.y0 + s / SIGHT;
+        if(bx < 0 || by < 0 || bx >= wide || by >= high)
+            continue;
+        const size_t here = (size_t) by * across(map) + bx;
+        const int x0 = bx << BLOCK_BITS;
+        const int y0 = by << BLOCK_BITS;
+        // East, west, north and south: the neighbour offsets, the portal bits, and where the portal edge lies.
+        const int dx[4] = { 1, -1, 0, 0 };
+        const int dy[4] = { 0, 0, 1, -1 };
+        const int edges[4] = {
+            map.portals[2 * here + 0],
+            bx > 0 ? map.portals[2 * (here - 1) + 0] : 0,
+            map.portals[2 * here + 1],
+            by > 0 ? map.portals[2 * (here - across(map)) + 1] : 0,
+        };
+        const int lines[4] = { x0 + BLOCK, x0, y0 + BLOCK, y0 };
+        for(int d = 0; d < 4; d++)
+        {
+            const int nx = s % SIGHT + dx[d];
+            const int ny = s / SIGHT + dy[d];
+            if(edges[d] == 0 || (unsigned) nx >= SIGHT || (unsigned) ny >= SIGHT)
+                continue;
+            // The portal spans from the first to the last open cell along the edge.
+            int lo = 0;
+            int hi = BLOCK;
+            while(!(edges[d] >> lo & 1))
+                lo++;
+            while(!(edges[d] >> (hi - 1) & 1))
+                hi--;
+            Point a = { lines[d], y0 + lo };
+            Point b = { lines[d], y0 + hi };
+            if(dy[d])
+            {
+                const Point c = { x0 + lo, lines[d] };
+                const Point e = { x0 + hi, lines[d] };
+                a = c;
+                b = e;
+            }
+            float window[2] = { sight.windows[2 * s + 0], sight.windows[2 * s + 1] };
+            narrow(camera, where, a, b, window);
+            if(window[0] > window[1])
+                continue;
+            const int n = ny * SIGHT + nx;
+            float* const next = sight.windows + 2 * n;
+            if(next[0] > next[1])
+            {
+                sight.sectors[sight.count++] = n;
+                next[0] = window[0];
+                next[1] = window[1];
+            }
+            else
+            if(window[0] < next[0] || window[1] > next[1])
+            {
+                next[0] = window[0] < next[0] ? window[0] : next[0];
+                next[1] = window[1] > next[1] ? window[1] : next[1];
+            }
+            else
+                continue;
+            if(!sight.queued[n])
+            {
+                sight.queued[n] = true;
+                sight.queue[tail] = n;
+                tail = (tail + 1) % (SIGHT * SIGHT);
+            }
+        }
+    }
+    camera.sight = sight;
+    return camera;
+}
+
+// Returns the frame of the scene from the <hero> perspective given a <map> for a <display>.
+// The <camera> must have been aimed with the hero.
+static Frame compose(const Hero hero, const Map map, const Display display, const Camera camera,
+    const Atlas* const atlas, Profiler* const profiler, const Sprites sprites)
+{
+    const Frame frame = { hero, map, display, camera, palette(), atlas, profiler, sprites.billboards, sprites.visible };
+    return frame;
+}
+
+// Changes the field of view. A focal value of 1.0 is 90 degrees.
+static Line viewport(const float focal)
+{
+    const Line fov = {
+        { focal, -1.0f },
+        { focal, +1.0f },
+    };
+    return fov;
+}
+
+static Hero born(const float focal)
+{
+    const Hero hero = {
+        viewport(focal),
+        // Where.
+        { 3.5f, 3.5f },
+        // Velocity.
+        { 0.0f, 0.0f },
+        // Speed (per tick).
+        0.10f,
+        // Acceleration (per tick).
+        0.015f,
+        // Theta radians.
+        0.0f,
+        // Collision radius.
+        0.2f
+    };
+    return hero;
+}
+
+// Returns the writable layers of the map cell at <x>, <y>, which must be on the map.
+static uint8_t* site(const Map map, const int x, const int y)
+{
+    return (uint8_t*) cell(map, x, y);
+}
+
+// Allocates an empty map of <width> by <height> cells.
+static Map blank(const int width, const int height)
+{
+#ifdef FIXED
+    if(width > FIXED_SIDE || height > FIXED_SIDE)
+    {
+        printf("maps are at most %d cells a side in fixed point builds\n", FIXED_SIDE);
+        exit(1);
+    }
+#endif
+    Map map = { NULL, width, height, (width + CHUNK - 1) / CHUNK, false, false, NULL, NULL, NULL };
+    map.cells = calloc(extent(map), 1);
+    if(map.cells == NULL)
+    {
+        puts("out of memory");
+        exit(1);
+    }
+    return map;
+}
+
+// Packs <height> rows of ascii digit layers into a map.
+static Map pack(const char** const ceiling, const char** const walling, const char** const floring, const int height)
+{
+    const Map map = blank(strlen(walling[0]), height);
+    for(int y = 0; y < map.height; y++)
+    for(int x = 0; x < map.width; x++)
+    {
+        uint8_t* const c = site(map, x, y);
+        c[CEILING] = ceiling[y][x] - '0';
+        c[WALLING] = walling[y][x] - '0';
+        c[FLORING] = floring[y][x] - '0';
+    }
+    return map;
+}
+
+// Builds the coarse occupancy blocks of a <map>. Blocks reaching past the map edge count as occupied
+// since everything outside the map reads as wall.
+static Map occupy(Map map)
+{
+    const size_t chunks = extent(map) / (CHUNK_CELLS * LAYERS);
+    map.blocks = calloc(chunks, sizeof(*map.blocks));
+    if(map.blocks == NULL)
+    {
+        puts("out of memory");
+        exit(1);
+    }
+    for(size_t i = 0; i < chunks; i++)
+    {
+        const int cx = (i % map.columns) << CHUNK_BITS;
+        const int cy = (i / map.columns) << CHUNK_BITS;
+        for(int y = cy; y < cy + CHUNK; y++)
+        for(int x = cx; x < cx + CHUNK; x++)
+            if(x >= map.width || y >= map.height || cell(map, x, y)[WALLING])
+                map.blocks[i] |= bit(x, y);
+    }
+    return map;
+}
+
+// Returns the number of sectors of a map, those of chunks reaching past the map edge included.
+static size_t sectors(const Map map)
+{
+    return extent(map) / (CHUNK_CELLS * LAYERS) << 2 * (CHUNK_BITS - BLOCK_BITS);
+}
+
+// Returns true if the map cell at <x>, <y> has no wall.
+static bool vacant(const Map map, const int x, const int y)
+{
+    return cell(map, x, y)[WALLING] == 0;
+}
+
+// Builds the sector portals of a <map>. Cells outside the map read as walls, so no portal leads off the map.
+static Map graph(Map map)
+{
+    const size_t count = sectors(map);
+    map.portals = calloc(count, 2);
+    if(map.portals == NULL)
+    {
+        puts("out of memory");
+        exit(1);
+    }
+    for(size_t i = 0; i < count; i++)
+    {
+        const int x0 = (i % across(map)) << BLOCK_BITS;
+        const int y0 = (i / across(map)) << BLOCK_BITS;
+        for(int j = 0; j < BLOCK; j++)
+        {
+            if(vacant(map, x0 + BLOCK - 1, y0 + j) && vacant(map, x0 + BLOCK, y0 + j))
+                map.portals[2 * i + 0] |= 1 << j;
+            if(vacant(map, x0 + j, y0 + BLOCK - 1) && vacant(map, x0 + j, y0 + BLOCK))
+                map.portals[2 * i + 1] |= 1 << j;
+        }
+    }
+    return map;
+}
+
+// Brings the occupancy bit of the block holding the cell at <x>, <y>, which must be on the map, up to date.
+static void reblock(const Map map, const int x, const int y)
+{
+    const int x0 = x & ~(BLOCK - 1);
+    const int y0 = y & ~(BLOCK - 1);
+    bool walled = false;
+    for(int j = y0; j < y0 + BLOCK; j++)
+    for(int i = x0; i < x0 + BLOCK; i++)
+        walled |= i >= map.width || j >= map.height || cell(map, i, j)[WALLING];
+    const size_t chunk = (size_t) (y >> CHUNK_BITS) * map.columns + (x >> CHUNK_BITS);
+    if(walled)
+        map.blocks[chunk] |= bit(x, y);
+    else
+        map.blocks[chunk] &= ~bit(x, y);
+}
+
+// Brings the portals through the east and north edges of the cell at <x>, <y> up to date, where those edges
+// are block edges. Cells off the map have no portals.
+static void gate(const Map map, const int x, const int y)
+{
+    if(x < 0 || y < 0 || x >= map.width || y >= map.height)
+        return;
+    const size_t i = (size_t) (y >> BLOCK_BITS) * across(map) + (x >> BLOCK_BITS);
+    if((x & (BLOCK - 1)) == BLOCK - 1)
+    {
+        const uint8_t b = 1 << (y & (BLOCK - 1));
+        const bool open = vacant(map, x, y) && vacant(map, x + 1, y);
+        map.portals[2 * i + 0] = open ? map.portals[2 * i + 0] | b : map.portals[2 * i + 0] & ~b;
+    }
+    if((y & (BLOCK - 1)) == BLOCK - 1)
+    {
+        const uint8_t b = 1 << (x & (BLOCK - 1));
+        const bool open = vacant(map, x, y) && vacant(map, x, y + 1);
+        map.portals[2 * i + 1] = open ? map.portals[2 * i + 1] | b : map.portals[2 * i + 1] & ~b;
+    }
+}
+
+// Sets a <layer> of the map cell at <x>, <y> to some <tile>, if the cell is on the map. Only the occupancy block
+// and the portals around the cell are brought up to date, so changing cells costs no rebuild. Changes to a mapped
+// map live in the private copy of the pages of their chunk, which is flagged edited to keep it resident.
+static void alter(Map* const map, const int x, const int y, const int layer, const int tile)
+{
+    if((unsigned) x >= (unsigned) map->width || (unsigned) y >= (unsigned) map->height)
+        return;
+    site(*map, x, y)[layer] = tile;
+    if(map->mapped)
+    {
+        if(map->edited == NULL)
+            map->edited = calloc(extent(*map) / (CHUNK_CELLS * LAYERS), 1);
+        if(map->edited == NULL)
+        {
+            puts("out of memory");
+            exit(1);
+        }
+        map->edited[(size_t) (y >> CHUNK_BITS) * map->columns + (x >> CHUNK_BITS)] = 1;
+    }
+    if(layer != WALLING)
+        return;
+    if(map->blocks)
+        reblock(*map, x, y);
+    if(map->portals)
+    {
+        gate(*map, x, y);
+        gate(*map, x - 1, y);
+        gate(*map, x, y - 1);
+    }
+}
+
+// Returns true if no wall stands between the centers of the map cells at <x0>, <y0> and <x1>, <y1>.
+// The line between them is sampled twice a cell, which is plenty for light falling off within SHINE cells.
+static bool reaches(const Map map, const int x0, const int y0, const int x1, const int y1)
+{
+    const int dx = x1 - x0;
+    const int dy = y1 - y0;
+    const int steps = 2 * (abs(dx) > abs(dy) ? abs(dx) : abs(dy));
+    for(int i = 1; i < steps; i++)
+    {
+        const int x = fl(x0 + 0.5f + (float) dx * i / steps);
+        const int y = fl(y0 + 0.5f + (float) dy * i / steps);
+        if((x != x1 || y != y1) && !vacant(map, x, y))
+            return false;
+    }
+    return true;
+}
+
+// Bakes some <count> of static point lights, scattered over open cells of a <map>, into the light of its cells.
+// Light falls off with the square of the distance out to SHINE cells and is blocked by walls, over an AMBIENT
+// floor so that unlit corners are dim but not black. Every chunk of a mapped map changes, so all stay resident.
+// Baking no lights leaves the map unlit.
+static Map bake(Map map, const int count)
+{
+    map.lit = count > 0;
+    if(!map.lit)
+        return map;
+    const size_t chunks = extent(map) / (CHUNK_CELLS * LAYERS);
+    if(map.mapped)
+    {
+        if(map.edited == NULL)
+            map.edited = malloc(chunks);
+        if(map.edited == NULL)
+        {
+            puts("out of memory");
+            exit(1);
+        }
+        memset(map.edited, 1, chunks);
+    }
+    for(size_t i = 0; i < chunks * CHUNK_CELLS; i++)
+        map.cells[LAYERS * i + LIGHTING] = AMBIENT;
+    // Gives up on a map too full of walls to hold them all, like scatter().
+    int baked = 0;
+    for(uint32_t n = 0; baked < count && n < 64u * count; n++)
+    {
+        const uint32_t a = noise(2 * n + 0x1105);
+        const uint32_t b = noise(2 * n + 0x1106);
+        const int lx = a % map.width;
+        const int ly = b % map.height;
+        if(!vacant(map, lx, ly))
+            continue;
+        const int strength = 160 + (a >> 16) % 96;
+        for(int y = ly - SHINE; y <= ly + SHINE; y++)
+        for(int x = lx - SHINE; x <= lx + SHINE; x++)
+        {
+            const float d = sqrtf((float) (x - lx) * (x - lx) + (float) (y - ly) * (y - ly)) / SHINE;
+            if(d >= 1.0f || (unsigned) x >= (unsigned) map.width || (unsigned) y >= (unsigned) map.height
+            || !reaches(map, lx, ly, x, y))
+                continue;
+            uint8_t* const c = site(map, x, y);
+            const int sum = c[LIGHTING] + (int) (strength * (1.0f - d) * (1.0f - d));
+            c[LIGHTING] = sum > 255 ? 255 : sum;
+        }
+        baked++;
+    }
+    return map;
+}
+
+// Generates an open <size> by <size> outdoor map scattered with pillars, for testing large levels.
+static Map generate(const int size)
+{
+    const Map map = blank(size, size);
+    for(int y = 0; y < size; y++)
+    for(int x = 0; x < size; x++)
+    {
+        uint8_t* const c = site(map, x, y);
+        const uint32_t n = noise(x + (uint32_t) y * size);
+        const bool edge = x == 0 || y == 0 || x == size - 1 || y == size - 1;
+        // Keeps the hero spawn clear.
+        const bool spawn = x < 6 && y < 6;
+        c[CEILING] = 1 + (n >> 8) % 3;
+        c[WALLING] = edge ? 1 : !spawn && n % 64 == 0 ? 1 + (n >> 16) % 3 : 0;
+        c[FLORING] = 1 + (n >> 12) % 3;
+    }
+    return map;
+}
+
+// Returns <sprites> with per frame working memory of their own for up to <count> sprites.
+static Sprites share(Sprites sprites, const int count)
+{
+    sprites.billboards = malloc(sizeof(*sprites.billboards) * count);
+    sprites.keys = malloc(sizeof(*sprites.keys) * count);
+    sprites.scratch = malloc(sizeof(*sprites.scratch) * count);
+    if(sprites.billboards == NULL || sprites.keys == NULL || sprites.scratch == NULL)
+    {
+        puts("out of memory");
+        exit(1);
+    }
+    return sprites;
+}
+
+// Scatters <count> sprites over empty cells of a <map>, keeping the cell of some <spawn> point clear.
+static Sprites scatter(const Map map, const int count, const Point spawn)
+{
+    Sprites sprites = { NULL, 0, NULL, NULL, NULL, 0 };
+    if(count == 0)
+        return sprites;
+    sprites.sprites = malloc(sizeof(*sprites.sprites) * count);
+    if(sprites.sprites == NULL)
+    {
+        puts("out of memory");
+        exit(1);
+    }
+    sprites = share(sprites, count);
+    // Gives up on a map too full of walls to hold them all.
+    for(uint32_t n = 0; sprites.count < count && n < 64u * count; n++)
+    {
+        const uint32_t a = noise(2 * n);
+        const uint32_t b = noise(2 * n + 1);
+        const int x = a % map.width;
+        const int y = b % map.height;
+        if(cell(map, x, y)[WALLING] || (x == fl(spawn.x) && y == fl(spawn.y)))
+            continue;
+        const Sprite sprite = { { x + 0.5f, y + 0.5f }, 0.25f, 1 + (a >> 16) % 5 };
+        sprites.sprites[sprites.count++] = sprite;
+    }
+    return sprites;
+}
+
+// Returns the section of some <kind> in a level <header>, or NULL if the level has none.
+static const Section* section(const Header* const header, const uint32_t kind)
+{
+    for(uint32_t i = 0; i < header->sections; i++)
+        if(header->table[i].kind == kind)
+            return &header->table[i];
+    return NULL;
+}
+
+// Opens a binary level <file>. The file is memory mapped copy on write and used in place without parsing,
+// so startup does not depend on the level size and cells are only paged in when looked up.
+static Map load(const char* const file)
+{
+    FILE* const fp = fopen(file, "rb");
+    if(fp == NULL)
+    {
+        printf("could not open %s\n", file);
+        exit(1);
+    }
+    Header header;
+    if(fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, magic, sizeof(magic)) != 0)
+    {
+        printf("%s is not a level file\n", file);
+        exit(1);
+    }
+    if(header.version != VERSION)
+    {
+        printf("%s is a level file version %u, expected version %d\n", file, header.version, VERSION);
+        exit(1);
+    }
+    if(header.chunk != CHUNK_BITS)
+    {
+        printf("%s is a level file of chunks 2^%u cells a side, expected 2^%d\n", file, header.chunk, CHUNK_BITS);
+        exit(1);
+    }
+    if(header.sections > SECTIONS)
+    {
+        printf("%s is corrupt\n", file);
+        exit(1);
+    }
+    fseek(fp, 0, SEEK_END);
+    const uint64_t bytes = ftell(fp);
+    // Every size below is worked out from the map dimensions, so dimensions that could not fit in the file,
+    // or would overflow on the way, are refused before anything is worked out from them.
+    const bool sized = header.width >= 1 && header.height >= 1 && header.width <= INT32_MAX - CHUNK && header.height <= INT32_MAX - CHUNK;
+    if(!sized || (uint64_t) ((header.width + CHUNK - 1) / CHUNK) * ((header.height + CHUNK - 1) / CHUNK) > bytes / PAGE)
+    {
+        printf("%s is corrupt\n", file);
+        exit(1);
+    }
+    Map map = { NULL, header.width, header.height, (header.width + CHUNK - 1) / CHUNK, true, false, NULL, NULL, NULL };
+    const Section* const cells = section(&header, CELLS);
+    const bool fits = cells && cells->size == extent(map) && cells->offset % PAGE == 0 && cells->offset + cells->size <= bytes;
+    const Section* const blocks = section(&header, BLOCKS);
+    const size_t words = extent(map) / (CHUNK_CELLS * LAYERS);
+    const bool skips = blocks && blocks->size == words * sizeof(*map.blocks) && blocks->offset % PAGE == 0 && blocks->offset + blocks->size <= bytes;
+    const Section* const portals = section(&header, PORTALS);
+    const bool links = portals && portals->size == 2 * sectors(map) && portals->offset % PAGE == 0 && portals->offset + portals->size <= bytes;
+    if(!fits || (blocks && !skips) || (portals && !links))
+    {
+        printf("%s is corrupt\n", file);
+        exit(1);
+    }
+#ifdef FIXED
+    if(map.width > FIXED_SIDE || map.height > FIXED_SIDE)
+    {
+        printf("%s is too large, fixed point builds take levels of at most %d cells a side\n", file, FIXED_SIDE);
+        exit(1);
+    }
+#endif
+    map.lit = (cells->flags & LIT) != 0;
+#ifdef _WIN32
+    // No memory mapping here: the cells are read in whole.
+    map.cells = malloc(cells->size);
+    map.mapped = false;
+    if(map.cells == NULL || fseek(fp, cells->offset, SEEK_SET) != 0 || fread(map.cells, cells->size, 1, fp) != 1)
+    {
+        printf("could not read %s\n", file);
+        exit(1);
+    }
+    if(blocks)
+    {
+        map.blocks = malloc(blocks->size);
+        if(map.blocks == NULL || fseek(fp, blocks->offset, SEEK_SET) != 0 || fread(map.blocks, blocks->size, 1, fp) != 1)
+        {
+            printf("could not read %s\n", file);
+            exit(1);
+        }
+    }
+    if(portals)
+    {
+        map.portals = malloc(portals->size);
+        if(map.portals == NULL || fseek(fp, portals->offset, SEEK_SET) != 0 || fread(map.portals, portals->size, 1, fp) != 1)
+        {
+            printf("could not read %s\n", file);
+            exit(1);
+        }
+    }
+#else
+    void* const memory = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(fp), 0);
+    if(memory == MAP_FAILED)
+    {
+        printf("could not map %s\n", file);
+        exit(1);
+    }
+    map.cells = (uint8_t*) memory + cells->offset;
+    if(blocks)
+        map.blocks = (uint64_t*) ((uint8_t*) memory + blocks->offset);
+    if(portals)
+        map.portals = (uint8_t*) memory + portals->offset;
+#endif
+    fclose(fp);
+    return map;
+}
+
+// Imports a text level <file>: the ceiling, walling and floring layers as rows of ascii digits, in that order,
+// each layer separated from the next by a blank line. Lines starting with # are comments.
+static Map import(const char* const file)
+{
+    FILE* const fp = fopen(file, "r");
+    if(fp == NULL)
+    {
+        printf("could not open %s\n", file);
+        exit(1);
+    }
+    char* rows[3][TEXT];
+    int counts[3] = { 0 };
+    int layer = 0;
+    char line[TEXT + 2];
+    while(fgets(line, sizeof(line), fp))
+    {
+        if(line[0] == '#')
+            continue;
+        line[strcspn(line, "\r\n")] = '\0';
+        if(line[0] == '\0')
+        {
+            layer += counts[layer] > 0;
+            continue;
+        }
+        if(layer == 3 || counts[layer] == TEXT || strspn(line, "0123456789") != strlen(line))
+        {
+            printf("%s is not a text level\n", file);
+            exit(1);
+        }
+        rows[layer][counts[layer]] = malloc(strlen(line) + 1);
+        if(rows[layer][counts[layer]] == NULL)
+        {
+            puts("out of memory");
+            exit(1);
+        }
+        strcpy(rows[layer][counts[layer]++], line);
+    }
+    fclose(fp);
+    const int height = counts[0];
+    bool valid = height > 0 && counts[1] == height && counts[2] == height;
+    for(int i = 0; valid && i < 3; i++)
+    for(int y = 0; valid && y < height; y++)
+        valid = strlen(rows[i][y]) == strlen(rows[0][0]);
+    if(!valid)
+    {
+        printf("%s layers differ in size\n", file);
+        exit(1);
+    }
+    const char** const ceiling = (const char**) rows[0];
+    const char** const walling = (const char**) rows[1];
+    const char** const floring = (const char**) rows[2];
+    return pack(ceiling, walling, floring, height);
+}
+
+// Opens a level <file>, binary or text.
+static Map level(const char* const file)
+{
+    FILE* const fp = fopen(file, "rb");
+    if(fp == NULL)
+    {
+        printf("could not open %s\n", file);
+        exit(1);
+    }
+    char head[sizeof(magic)] = { 0 };
+    const bool binary = fread(head, sizeof(head), 1, fp) == 1 && memcmp(head, magic, sizeof(magic)) == 0;
+    fclose(fp);
+    return binary ? load(file) : import(file);
+}
+
+// Builds the map. Note the static prefix for the parties. The ascii layers live in .bss in private.
+static Map build()
+{
+    static const char* ceiling[] = {
+        "111111111111111111111111111111111111111111111",
+        "122223223232232111111111111111222232232322321",
+        "122222221111232111111111111111222222211112321",
+        "122221221232323232323232323232222212212323231",
+        "122222221111232111111111111111222222211112321",
+        "122223223232232111111111111111222232232322321",
+        "111111111111111111111111111111111111111111111",
+    };
+    static const char* walling[] = {
+        "111111111111111111111111111111111111111111111",
+        "100000000000000111111111111111000000000000001",
+        "103330001111000111111111111111033300011110001",
+        "103000000000000000000000000000030000030000001",
+        "103330001111000111111111111111033300011110001",
+        "100000000000000111111111111111000000000000001",
+        "111111111111111111111111111111111111111111111",
+    };
+    static const char* floring[] = {
+        "111111111111111111111111111111111111111111111",
+        "122223223232232111111111111111222232232322321",
+        "122222221111232111111111111111222222211112321",
+        "122222221232323323232323232323222222212323231",
+        "122222221111232111111111111111222222211112321",
+        "122223223232232111111111111111222232232322321",
+        "111111111111111111111111111111111111111111111",
+    };
+    return pack(ceiling, walling, floring, sizeof(walling) / sizeof(*walling));
+}
+
+// The library side of littlewolf.h.
+
+struct lw_map
+{
+    Map map;
+    Sprites sprites;
+};
+
+// Batches are rendered VIEWS frames at a time, each with its own <cameras> and <sprites> working memory
+// for up to <room> sprites.
+struct lw_renderer
+{
+    Pool pool;
+    Camera cameras[VIEWS];
+    Sprites sprites[VIEWS];
+    int room;
+    Atlas atlas;
+    bool textured;
+    int xres;
+    int yres;
+};
+
+// Wraps up a <map> ready for rendering, with some number of <sprites> scattered over it.
+static lw_map* wrap(Map map, const int sprites)
+{
+    lw_map* const wrapped = malloc(sizeof(*wrapped));
+    if(wrapped == NULL)
+    {
+        puts("out of memory");
+        exit(1);
+    }
+    if(map.blocks == NULL)
+        map = occupy(map);
+    if(map.portals == NULL)
+        map = graph(map);
+    wrapped->map = map;
+    wrapped->sprites = scatter(map, sprites, born(0.8f).where);
+    return wrapped;
+}
+
+lw_map* lw_load(const char* const file, const int sprites)
+{
+    return wrap(file ? level(file) : build(), sprites < 0 ? 0 : sprites);
+}
+
+lw_map* lw_generate(const int size, const int sprites)
+{
+    return wrap(generate(size < 1 ? 1 : size), sprites < 0 ? 0 : sprites);
+}
+
+int lw_width(const lw_map* const map)
+{
+    return map->map.width;
+}
+
+int lw_height(const lw_map* const map)
+{
+    return map->map.height;
+}
+
+int lw_solid(const lw_map* const map, const int x, const int y)
+{
+    return !vacant(map->map, x, y);
+}
+
+int lw_tile(const lw_map* const map, const int x, const int y, const int layer)
+{
+    return layer == CEILING || layer == WALLING || layer == FLORING ? cell(map->map, x, y)[layer] : 0;
+}
+
+void lw_bake(lw_map* const map, const int lights)
+{
+    map->map = bake(map->map, lights < 0 ? 0 : lights);
+}
+
+void lw_set(lw_map* const map, const int x, const int y, const int layer, const int tile)
+{
+    if(layer == CEILING || layer == WALLING || layer == FLORING)
+        alter(&map->map, x, y, layer, tile);
+}
+
+lw_renderer* lw_create(const int xres, const int yres, const int threads, const int textured)
+{
+    lw_renderer* const renderer = calloc(1, sizeof(*renderer));
+    if(renderer == NULL)
+    {
+        puts("out of memory");
+        exit(1);
+    }
+    // The lookup tables are built up front, as threads would race to build them.
+    palette();
+    spectrum();
+    colormap();
+#ifdef FIXED
+    sines();
+#endif
+    renderer->pool = spawn(threads);
+    start(&renderer->pool);
+    for(int i = 0; i < VIEWS; i++)
+        renderer->cameras[i] = lens(xres < 1 ? 1 : xres, yres < 1 ? 1 : yres, 1, false, false);
+    renderer->textured = textured;
+    if(textured)
+        renderer->atlas = atlas(16, 6);
+    renderer->xres = renderer->cameras[0].xres;
+    renderer->yres = renderer->cameras[0].yres;
+    return renderer;
+}
+
+void lw_render_batch(lw_renderer* const renderer, const lw_map* const map, const lw_pose* const poses, const int count,
+    uint32_t* const* const buffers)
+{
+    // Makes room for the sprites of the map, which may be more than those of the last map.
+    if(renderer->room < map->sprites.count)
+    {
+        for(int i = 0; i < VIEWS; i++)
+        {
+            free(renderer->sprites[i].billboards);
+            free(renderer->sprites[i].keys);
+            free(renderer->sprites[i].scratch);
+            renderer->sprites[i] = share(map->sprites, map->sprites.count);
+        }
+        renderer->room = map->sprites.count;
+    }
+    const Atlas* const a = renderer->textured ? &renderer->atlas : NULL;
+    for(int i = 0; i < count; i += VIEWS)
+    {
+        const int views = count - i < VIEWS ? count - i : VIEWS;
+        Frame frames[VIEWS];
+        for(int j = 0; j < views; j++)
+        {
+            Hero hero = born(0.8f);
+            hero.where.x = poses[i + j].x;
+            hero.where.y = poses[i + j].y;
+            hero.theta = poses[i + j].theta;
+            Camera* const camera = &renderer->cameras[j];
+            Sprites* const sprites = &renderer->sprites[j];
+            sprites->sprites = map->sprites.sprites;
+            sprites->count = map->sprites.count;
+            *camera = look(aim(*camera, hero), map->map, hero.where);
+            *sprites = depict(*sprites, *camera, hero, map->map, palette());
+            const Display display = { buffers[i + j], renderer->yres };
+            frames[j] = compose(hero, map->map, display, *camera, a, NULL, *sprites);
+        }
+        // All frames of the batch are rendered on the one queue of column tiles.
+        raster(&renderer->pool, frames, views);
+    }
+}
@@ -0,0 +1,83 @@
+// The littlewolf batch renderer. Renders frames of a level offscreen, many poses at a time, across a pool
+// of threads, into buffers the caller owns. No window, no SDL.
+//
+// Build the static library with make lib and link with -llittlewolf -lpthread -lm.
+// Like the game, the library prints and exits on errors, and frees nothing: maps and renderers
+// live until the program exits.
+
+#ifndef LITTLEWOLF_H
+#define LITTLEWOLF_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A level and the sprites scattered over it. One map can be rendered by any number of renderers at once,
+// as long as none of its cells change while any of them renders it.
+typedef struct lw_map lw_map;
+
+// Renders frames of one resolution on its own threads. One thread renders with a renderer at a time.
+typedef struct lw_renderer lw_renderer;
+
+// The layers of a map cell.
+enum
+{
+    LW_CEILING,
+    LW_WALLING,
+    LW_FLORING
+};
+
+// Where a frame is seen from, in map cells, and which way, in radians.
+typedef struct
+{
+    float x;
+    float y;
+    float theta;
+}
+lw_pose;
+
+// Opens a level file, binary or text, or the built-in level if the <file> is NULL,
+// and scatters some number of <sprites> over it.
+lw_map* lw_load(const char* file, int sprites);
+
+// Generates an open <size> by <size> level scattered with pillars and some number of <sprites>.
+lw_map* lw_generate(int size, int sprites);
+
+// Returns the width of a <map> in cells.
+int lw_width(const lw_map* map);
+
+// Returns the height of a <map> in cells.
+int lw_height(const lw_map* map);
+
+// Returns nonzero if the cell at <x>, <y> of a <map> is a wall. Cells off the map are walls.
+int lw_solid(const lw_map* map, int x, int y);
+
+// Returns the tile of a <layer> of the cell at <x>, <y> of a <map>, 0 for none. Cells off the map are walls.
+int lw_tile(const lw_map* map, int x, int y, int layer);
+
+// Sets a <layer> of the cell at <x>, <y> of a <map> to some <tile> from 0 to 255, 0 for none, opening or closing
+// walls for doors and moving walls, or changing looks for animated tiles. Cells off the map stay as they are.
+// Only what is cached about the cells around the cell is brought up to date, so maps can change every frame.
+void lw_set(lw_map* map, int x, int y, int layer, int tile);
+
+// Bakes some number of static point <lights>, scattered over the open cells of a <map>, into its lightmap,
+// which walls, floors, ceilings and sprites are then lit by at the cost of a multiply a pixel. Zero lights
+// leave the map unlit. Lights stay where they were baked as cells change.
+void lw_bake(lw_map* map, int lights);
+
+// Creates a renderer of <xres> by <yres> frames on some number of <threads>, <textured> or in flat colors.
+lw_renderer* lw_create(int xres, int yres, int threads, int textured);
+
+// Renders <count> frames of a <map>, one seen from each of the <poses>, into as many <buffers>.
+// Every buffer holds xres * yres ARGB8888 pixels, laid out on its side as the renderer draws them:
+// xres columns of yres pixels each, from the left of the frame to the right, every column running
+// from the bottom of the frame to the top. Returns once all frames are done.
+void lw_render_batch(lw_renderer* renderer, const lw_map* map, const lw_pose* poses, int count, uint32_t* const* buffers);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,218 +1,233 @@
-#include <SDL2/SDL.h>
-#include <math.h>
-#include <stdbool.h>
-#include <stdio.h>
-
-typedef struct
-{
-    float x;
-    float y;
-}
-Point;
-
-typedef struct
-{
-    int tile;
-    Point where;
-}
-Hit;
+// The game. The engine is built into the same translation unit so the game can reach all of it;
+// other programs link the engine library through littlewolf.h instead.
+#include "littlewolf.c"
 
-typedef struct
-{
-    Point a;
-    Point b;
-}
-Line;
+#include <SDL2/SDL.h>
 
+// The software gpu. With more than one of its <buffers>, frames are rasterised into
+// alternating CPU <back> buffers and uploaded to rotating streaming <textures>.
+// Frames may be rendered smaller than the window: the <areas> of the textures and the <extents>
+// of the back buffers hold the part rendered, which is stretched to the window when presented.
 typedef struct
 {
     SDL_Window* window;
     SDL_Renderer* renderer;
-    SDL_Texture* texture;
+    SDL_Texture* textures[3];
+    Display back[2];
+    SDL_Rect areas[3];
+    SDL_Rect extents[2];
+    int buffers;
     int xres;
     int yres;
 }
 Gpu;
 
-typedef struct
+// Resolution steps, from the full window resolution down to a third of it.
+enum
 {
-    uint32_t* pixels;
-    int width;
-}
-Display;
+    RUNGS = 8
+};
 
+// Dynamic resolution. Renders with one of its <cameras> at ever lower resolutions, one <rung> per step,
+// the rung moving down or up to hold the frame render time <average> to some <target> seconds.
+// A <cooldown> of frames after every step lets the average settle. Every rung has a camera for each of the <views>.
 typedef struct
 {
-    int top;
-    int bot;
-    float size;
+    Camera cameras[RUNGS][VIEWS];
+    int views;
+    int rung;
+    double target;
+    double average;
+    int cooldown;
 }
-Wall;
+Throttle;
 
+// A circle of some <radius> filed in a spatial hash <bucket> (-1 if it is not in the hash),
+// chained to the <next> body of the same bucket (-1 for none).
 typedef struct
 {
-    Line fov;
     Point where;
-    Point velocity;
-    float speed;
-    float acceleration;
-    float theta;
+    float radius;
+    int bucket;
+    int next;
 }
-Hero;
+Body;
 
+// A spatial hash of <count> bodies on a uniform grid of map cells. The <mask> selects a bucket from a cell hash,
+// and <heads> holds the first body of every bucket. Bodies are filed under the cell of their center and are at most
+// REACH in radius, so bodies near some point are found in the few buckets of cells around it.
 typedef struct
 {
-    const char** ceiling;
-    const char** walling;
-    const char** floring;
+    int* heads;
+    Body* bodies;
+    int count;
+    uint32_t mask;
 }
-Map;
+Grid;
 
-// Rotates the player by some radian value.
-static Point turn(const Point a, const float t)
-{
-    const Point b = { a.x * cosf(t) - a.y * sinf(t), a.x * sinf(t) + a.y * cosf(t) };
-    return b;
-}
-
-// Rotates a point 90 degrees.
-static Point rag(const Point a)
-{
-    const Point b = { -a.y, a.x };
-    return b;
-}
+#define REACH 0.5f
 
-// Subtracts two points.
-static Point sub(const Point a, const Point b)
+// Key strokes waiting to be simulated, at most.
+enum
 {
-    const Point c = { a.x - b.x, a.y - b.y };
-    return c;
-}
+    STROKES = 256
+};
 
-// Adds two points.
-static Point add(const Point a, const Point b)
+// A key press or release of some <key> scancode at some <time> in seconds.
+typedef struct
 {
-    const Point c = { a.x + b.x, a.y + b.y };
-    return c;
+    double time;
+    int key;
+    bool down;
 }
+Stroke;
 
-// Multiplies a point by a scalar value.
-static Point mul(const Point a, const float n)
+// Keyboard input. All events waiting are drained every frame, and their key <strokes> are kept, stamped with
+// the time they happened, until fed to the simulation tick they fall in, <count> of them waiting.
+// The <keys> are the key state a tick sees: a key is held for a tick if it was down at any time during the tick,
+// so that a tap shorter than a tick still counts, and the <struck> keys are those pressed during the tick.
+// The <down> state is the last state of every key fed so far. The <pressed> time is that of the earliest key
+// press fed since the last rendered frame, 0 for none.
+typedef struct
 {
-    const Point b = { a.x * n, a.y * n };
-    return b;
+    Stroke strokes[STROKES];
+    int count;
+    uint8_t keys[SDL_NUM_SCANCODES];
+    uint8_t struck[SDL_NUM_SCANCODES];
+    uint8_t down[SDL_NUM_SCANCODES];
+    double pressed;
+    bool quit;
 }
+Input;
 
-// Returns the magnitude of a point.
-static float mag(const Point a)
+// Input to photon latency: the time of the earliest key press every frame in flight shows, <pressed> by
+// the frame number, 0 for none, and the <best>, <worst> and <total> latency over some <count> of presses.
+// The photon comes with the present of the frame, which is as close to the display as software sees.
+typedef struct
 {
-    return sqrtf(a.x * a.x + a.y * a.y);
+    double pressed[3];
+    double best;
+    double worst;
+    double total;
+    int count;
 }
+Latency;
 
-// Returns the unit vector of a point.
-static Point unit(const Point a)
-{
-    return mul(a, 1.0f / mag(a));
-}
+// The keys a replay records, in the order of their bits.
+static const SDL_Scancode controls[] = {
+    SDL_SCANCODE_W, SDL_SCANCODE_A, SDL_SCANCODE_S, SDL_SCANCODE_D, SDL_SCANCODE_H, SDL_SCANCODE_L, SDL_SCANCODE_E,
+};
 
-// Returns the slope of a point.
-static float slope(const Point a)
+// Replay file versioning, apart from level file versioning: replays only change version when their format does.
+enum
 {
-    return a.y / a.x;
-}
+    REPLAY = 1
+};
 
-// Fast floor (math.h is too slow).
-static int fl(const float x)
-{
-    return (int) x - (x < (int) x);
-}
+static const char reel[4] = { 'L', 'W', 'R', 'P' };
 
-// Fast ceil (math.h is too slow).
-static int cl(const float x)
+// The replay file header. A replay only plays back the same way on a level of the same size with as many sprites.
+// The header is followed by one 16-bit word per simulation tick: the low byte has a bit per control held during
+// the tick, and the high byte a bit per control struck.
+typedef struct
 {
-    return (int) x + (x > (int) x);
+    char magic[4];
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    int32_t sprites;
 }
+Take;
 
-// Steps horizontally along a square grid.
-static Point sh(const Point a, const Point b)
+// A replay of <count> simulation <ticks>, recorded as in a replay file.
+typedef struct
 {
-    const float x = b.x > 0.0f ? fl(a.x + 1.0f) : cl(a.x - 1.0f);
-    const float y = slope(b) * (x - a.x) + a.y;
-    const Point c = { x, y };
-    return c;
+    uint16_t* ticks;
+    int count;
 }
+Replay;
 
-// Steps vertically along a square grid.
-static Point sv(const Point a, const Point b)
+// A camera path of <count> hero keyframes.
+typedef struct
 {
-    const float y = b.y > 0.0f ? fl(a.y + 1.0f) : cl(a.y - 1.0f);
-    const float x = (y - a.y) / slope(b) + a.x;
-    const Point c = { x, y };
-    return c;
+    Hero* keys;
+    int count;
 }
+Path;
 
-// Returns a decimal value of the ascii tile value on the map.
-static int tile(const Point a, const char** const tiles)
+typedef struct
 {
-    const int x = a.x;
-    const int y = a.y;
-    return tiles[y][x] - '0';
+    int threads;
+    const char* bench;
+    const char* trace;
+    int fps;
+    bool vsync;
+    int buffers;
+    bool textures;
+    int frames;
+    int xres;
+    int yres;
+    const char* level;
+    int generate;
+    const char* export;
+    bool skip;
+    int sprites;
+    bool lazy;
+    double target;
+    int interleave;
+    bool indexed;
+    bool cull;
+    int views;
+    bool latency;
+    int lights;
+    const char* record;
+    const char* replay;
+    bool tiled;
 }
+Args;
 
-// Floating point decimal.
-static float dec(const float x)
+// Rotates the player by some radian value.
+static Point turn(const Point a, const float t)
 {
-    return x - (int) x;
+    return orient(a, cosf(t), sinf(t));
 }
 
-// Casts a ray from <where> in unit <direction> until a <walling> tile is hit.
-static Hit cast(const Point where, const Point direction, const char** const walling)
+// Rotates a point 90 degrees.
+static Point rag(const Point a)
 {
-    // Determine whether to step horizontally or vertically on the grid.
-    const Point hor = sh(where, direction);
-    const Point ver = sv(where, direction);
-    const Point ray = mag(sub(hor, where)) < mag(sub(ver, where)) ? hor : ver;
-    // Due to floating point error, the step may not make it to the next grid square.
-    // Three directions (dy, dx, dc) of a tiny step will be added to the ray
-    // depending on if the ray hit a horizontal wall, a vertical wall, or the corner
-    // of two walls, respectively.
-    const Point dc = mul(direction, 0.01f);
-    const Point dx = { dc.x, 0.0f };
-    const Point dy = { 0.0f, dc.y };
-    const Point test = add(ray,
-        // Tiny step for corner of two grid squares.
-        mag(sub(hor, ver)) < 1e-3f ? dc :
-        // Tiny step for vertical grid square.
-        dec(ray.x) == 0.0f ? dx :
-        // Tiny step for a horizontal grid square.
-        dy);
-    const Hit hit = { tile(test, walling), ray };
-    // If a wall was not hit, then continue advancing the ray.
-    return hit.tile ? hit : cast(ray, direction, walling);
+    const Point b = { -a.y, a.x };
+    return b;
 }
 
-// Party casting. Returns a percentage of <y> related to <yres> for ceiling and
-// floor casting when lerping the floor or ceiling.
-static float pcast(const float size, const int yres, const int y)
+// Returns the tile value of a map <layer> at some point.
+static int tile(const Point a, const Map map, const int layer)
 {
-    return size / (2 * (y + 1) - yres);
+    return cell(map, fl(a.x), fl(a.y))[layer];
 }
 
-// Rotates a line by some radian amount.
-static Line rotate(const Line l, const float t)
+// Returns the unit vector of a point.
+static Point unit(const Point a)
 {
-    const Line line = { turn(l.a, t), turn(l.b, t) };
-    return line;
+    return mul(a, 1.0f / mag(a));
 }
 
-// Linear interpolation.
-static Point lerp(const Line l, const float n)
+// Allocates a cache line aligned display of <xres> by <yres> pixels not backed by any gpu.
+// Columns are padded to whole cache lines like a locked streaming texture.
+static Display offscreen(const int xres, const int yres)
 {
-    return add(l.a, mul(sub(l.b, l.a), n));
+    const int width = (yres + 15) / 16 * 16;
+    char* const memory = malloc(sizeof(uint32_t) * width * xres + 64);
+    if(memory == NULL)
+    {
+        puts("out of memory");
+        exit(1);
+    }
+    const Display display = { (uint32_t*) (memory + (64 - (uintptr_t) memory % 64)), width };
+    return display;
 }
 
-// Setups the software gpu.
-static Gpu setup(const int xres, const int yres, const bool vsync)
+// Setups the software gpu with 1 to 3 <buffers>.
+static Gpu setup(const int xres, const int yres, const bool vsync, const int buffers)
 {
     SDL_Init(SDL_INIT_VIDEO);
     SDL_Window* const window = SDL_CreateWindow(
@@ -225,55 +240,113 @@ static Gpu setup(const int xres, const int yres, const bool vsync)
         window,
         -1,
         SDL_RENDERER_ACCELERATED | (vsync ? SDL_RENDERER_PRESENTVSYNC : 0x0));
-    // Notice the flip between xres and yres.
-    // The texture is 90 degrees flipped on its side for fast cache access.
-    SDL_Texture* const texture = SDL_CreateTexture(
-        renderer,
-        SDL_PIXELFORMAT_ARGB8888,
-        SDL_TEXTUREACCESS_STREAMING,
-        yres, xres);
-    if(window == NULL || renderer == NULL || texture == NULL)
+    if(window == NULL || renderer == NULL)
     {
         puts(SDL_GetError());
         exit(1);
     }
-    const Gpu gpu = { window, renderer, texture, xres, yres };
+    Gpu gpu;
+    memset(&gpu, 0, sizeof(gpu));
+    gpu.window = window;
+    gpu.renderer = renderer;
+    gpu.buffers = buffers;
+    gpu.xres = xres;
+    gpu.yres = yres;
+    for(int i = 0; i < buffers; i++)
+    {
+        // Notice the flip between xres and yres.
+        // The texture is 90 degrees flipped on its side for fast cache access.
+        gpu.textures[i] = SDL_CreateTexture(
+            renderer,
+            SDL_PIXELFORMAT_ARGB8888,
+            SDL_TEXTUREACCESS_STREAMING,
+            yres, xres);
+        if(gpu.textures[i] == NULL)
+        {
+            puts(SDL_GetError());
+            exit(1);
+        }
+        const SDL_Rect area = { 0, 0, yres, xres };
+        gpu.areas[i] = area;
+    }
+    if(buffers > 1)
+        for(int i = 0; i < 2; i++)
+            gpu.back[i] = offscreen(xres, yres);
     return gpu;
 }
 
-// Presents the software gpu to the window.
+// Presents the texture of some <frame> to the window.
 // Calls the real GPU to rotate texture back 90 degrees before presenting.
-static void present(const Gpu gpu)
+static void present(const Gpu gpu, const int frame)
 {
     const SDL_Rect dst = {
         (gpu.xres - gpu.yres) / 2,
         (gpu.yres - gpu.xres) / 2,
         gpu.yres, gpu.xres,
     };
-    SDL_RenderCopyEx(gpu.renderer, gpu.texture, NULL, &dst, -90, NULL, SDL_FLIP_NONE);
+    const int i = frame % gpu.buffers;
+    SDL_RenderCopyEx(gpu.renderer, gpu.textures[i], &gpu.areas[i], &dst, -90, NULL, SDL_FLIP_NONE);
     SDL_RenderPresent(gpu.renderer);
 }
 
-// Locks the gpu, returning a pointer to video memory.
-static Display lock(const Gpu gpu)
+// Returns true if the window is hidden or minimised, so that presenting to it is wasted.
+static bool hidden(const Gpu gpu)
+{
+    return SDL_GetWindowFlags(gpu.window) & (SDL_WINDOW_HIDDEN | SDL_WINDOW_MINIMIZED);
+}
+
+// Locks the texture of some <frame>, returning a pointer to video memory.
+static Display lock(const Gpu gpu, const int frame)
 {
     void* screen;
     int pitch;
-    SDL_LockTexture(gpu.texture, NULL, &screen, &pitch);
+    SDL_LockTexture(gpu.textures[frame % gpu.buffers], NULL, &screen, &pitch);
     const Display display = { (uint32_t*) screen, pitch / (int) sizeof(uint32_t) };
     return display;
 }
 
-// Places a pixels in gpu video memory.
-static void put(const Display display, const int x, const int y, const uint32_t pixel)
+// Unlocks the texture of some <frame>, making the pointer to video memory ready for presentation
+static void unlock(const Gpu gpu, const int frame)
+{
+    SDL_UnlockTexture(gpu.textures[frame % gpu.buffers]);
+}
+
+// Uploads the rendered part of the back buffer of some <frame> to its texture.
+static void upload(Gpu* const gpu, const int frame)
+{
+    const Display back = gpu->back[frame % 2];
+    const SDL_Rect extent = gpu->extents[frame % 2];
+    SDL_UpdateTexture(gpu->textures[frame % gpu->buffers], &extent, back.pixels, back.width * (int) sizeof(*back.pixels));
+    gpu->areas[frame % gpu->buffers] = extent;
+}
+
+// Returns how many <views> are laid out across a display.
+static int wide(const int views)
+{
+    return views > 1 ? 2 : 1;
+}
+
+// Returns how many <views> are laid out down a display.
+static int tall(const int views)
 {
-    display.pixels[y + x * display.width] = pixel;
+    return views > 2 ? 2 : 1;
 }
 
-// Unlocks the gpu, making the pointer to video memory ready for presentation
-static void unlock(const Gpu gpu)
+// Returns the part of a texture, on its side, covered by frames of <views> views through cameras like some <camera>.
+static SDL_Rect area(const Camera camera, const int views)
 {
-    SDL_UnlockTexture(gpu.texture);
+    const SDL_Rect rect = { 0, 0, camera.yres * tall(views), camera.xres * wide(views) };
+    return rect;
+}
+
+// Returns the part of a <display> some <view> out of <views> views through a <camera> renders to, from the top left
+// in reading order. Views keep the column stride of the display, so they render like any display.
+static Display portion(const Display display, const Camera camera, const int view, const int views)
+{
+    const int x = view % wide(views) * camera.xres;
+    const int y = (tall(views) - 1 - view / wide(views)) * camera.yres;
+    const Display part = { display.pixels + x * display.width + y, display.width };
+    return part;
 }
 
 // Spins the hero when keys h,l are held down.
@@ -284,10 +357,153 @@ static Hero spin(Hero hero, const uint8_t* key)
     return hero;
 }
 
-// Moves the hero when w,a,s,d are held down. Handles collision detection for the walls.
-static Hero move(Hero hero, const char** const walling, const uint8_t* key)
+// Returns the spatial hash bucket of the map cell at <x>, <y>.
+static int bucket(const Grid grid, const int x, const int y)
+{
+    return ((uint32_t) x * 73856093u ^ (uint32_t) y * 19349663u) & grid.mask;
+}
+
+// Allocates an empty spatial hash for <count> bodies.
+static Grid hashed(const int count)
+{
+    Grid grid = { NULL, NULL, count, 0 };
+    uint32_t buckets = 16;
+    while(buckets < 2u * count)
+        buckets *= 2;
+    grid.mask = buckets - 1;
+    grid.heads = malloc(sizeof(*grid.heads) * buckets);
+    grid.bodies = malloc(sizeof(*grid.bodies) * (count > 0 ? count : 1));
+    if(grid.heads == NULL || grid.bodies == NULL)
+    {
+        puts("out of memory");
+        exit(1);
+    }
+    for(uint32_t i = 0; i < buckets; i++)
+        grid.heads[i] = -1;
+    for(int i = 0; i < count; i++)
+        grid.bodies[i].bucket = -1;
+    return grid;
+}
+
+// Files body <id> as a circle of some <radius> at <where> in a spatial hash.
+static void insert(Grid* const grid, const int id, const Point where, const float radius)
+{
+    Body* const body = &grid->bodies[id];
+    body->where = where;
+    body->radius = radius > REACH ? REACH : radius;
+    body->bucket = bucket(*grid, fl(where.x), fl(where.y));
+    body->next = grid->heads[body->bucket];
+    grid->heads[body->bucket] = id;
+}
+
+// Takes body <id> out of a spatial hash.
+static void discard(Grid* const grid, const int id)
+{
+    Body* const body = &grid->bodies[id];
+    if(body->bucket < 0)
+        return;
+    int* link = &grid->heads[body->bucket];
+    while(*link != id)
+        link = &grid->bodies[*link].next;
+    *link = body->next;
+    body->bucket = -1;
+}
+
+// Lists up to <max> <ids> of the bodies of a spatial hash overlapping a circle of some <radius> at <where>.
+// Returns how many there are, which may be more than <max>.
+static int query(const Grid grid, const Point where, const float radius, int* const ids, const int max)
+{
+    int count = 0;
+    const float reach = radius + REACH;
+    for(int y = fl(where.y - reach); y <= fl(where.y + reach); y++)
+    for(int x = fl(where.x - reach); x <= fl(where.x + reach); x++)
+        for(int id = grid.heads[bucket(grid, x, y)]; id >= 0; id = grid.bodies[id].next)
+        {
+            const Body body = grid.bodies[id];
+            // Buckets are shared by distant cells.
+            if(fl(body.where.x) != x || fl(body.where.y) != y)
+                continue;
+            const float r = radius + body.radius;
+            const Point d = sub(body.where, where);
+            if(d.x * d.x + d.y * d.y < r * r)
+            {
+                if(count < max)
+                    ids[count] = id;
+                count++;
+            }
+        }
+    return count;
+}
+
+// Files all <sprites> in a new spatial hash, with their indices for ids, leaving room for <actors> more bodies.
+static Grid crowd(const Sprites sprites, const int actors)
+{
+    Grid grid = hashed(sprites.count + actors);
+    for(int i = 0; i < sprites.count; i++)
+        insert(&grid, i, sprites.sprites[i].where, sprites.sprites[i].radius);
+    return grid;
+}
+
+// Returns true if a circle of some <radius> at <where> overlaps a wall of the <map> or a body of the <grid>.
+static bool blocked(const Point where, const float radius, const Map map, const Grid grid)
+{
+    for(int y = fl(where.y - radius); y <= fl(where.y + radius); y++)
+    for(int x = fl(where.x - radius); x <= fl(where.x + radius); x++)
+        if(cell(map, x, y)[WALLING])
+        {
+            // Distance to the nearest point of the wall square.
+            const float nx = where.x < x ? x : where.x > x + 1 ? x + 1 : where.x;
+            const float ny = where.y < y ? y : where.y > y + 1 ? y + 1 : where.y;
+            const Point d = { where.x - nx, where.y - ny };
+            if(d.x * d.x + d.y * d.y < radius * radius)
+                return true;
+        }
+    return query(grid, where, radius, NULL, 0) > 0;
+}
+
+// Returns point <a> moved by <d> along some <axis> (0 for x, 1 for y).
+static Point nudge(Point a, const int axis, const float d)
+{
+    if(axis) a.y += d; else a.x += d;
+    return a;
+}
+
+// Sweeps the hero circle along the velocity on one <axis> in steps shorter than its radius, so no wall or body
+// is tunnelled through. On contact, closes in on the point of contact by bisection and stops the hero on that
+// axis only, so that it slides along whatever it hit.
+static Hero sweep(Hero hero, const Map map, const Grid grid, const int axis)
+{
+    const float velocity = axis ? hero.velocity.y : hero.velocity.x;
+    const int steps = 1 + fabsf(velocity) / hero.radius;
+    const float step = velocity / steps;
+    for(int i = 0; i < steps; i++)
+    {
+        if(!blocked(nudge(hero.where, axis, step), hero.radius, map, grid))
+        {
+            hero.where = nudge(hero.where, axis, step);
+            continue;
+        }
+        float lo = 0.0f;
+        float hi = step;
+        for(int j = 0; j < 8; j++)
+        {
+            const float mid = 0.5f * (lo + hi);
+            if(blocked(nudge(hero.where, axis, mid), hero.radius, map, grid))
+                hi = mid;
+            else
+                lo = mid;
+        }
+        hero.where = nudge(hero.where, axis, lo);
+        hero.velocity = nudge(hero.velocity, axis, -velocity);
+        break;
+    }
+    return hero;
+}
+
+// Moves the hero when w,a,s,d are held down. Handles swept collision detection for the walls
+// and the bodies of some spatial hash <grid>, in which the hero is filed as body <id>.
+static Hero move(Hero hero, const Map map, Grid* const grid, const int id, const uint8_t* key)
 {
-    const Point last = hero.where, zero = { 0.0f, 0.0f };
     // Accelerates with key held down.
     if(key[SDL_SCANCODE_W] || key[SDL_SCANCODE_S] || key[SDL_SCANCODE_D] || key[SDL_SCANCODE_A])
     {
@@ -303,162 +519,961 @@ static Hero move(Hero hero, const char** const walling, const uint8_t* key)
     else hero.velocity = mul(hero.velocity, 1.0f - hero.acceleration / hero.speed);
     // Caps velocity if top speed is exceeded.
     if(mag(hero.velocity) > hero.speed) hero.velocity = mul(unit(hero.velocity), hero.speed);
-    // Moves.
-    hero.where = add(hero.where, hero.velocity);
-    // Sets velocity to zero if there is a collision and puts hero back in bounds.
-    if(tile(hero.where, walling))
+    // Moves one axis at a time, sliding along walls. A hero already stuck (say, spawned in a wall)
+    // falls back to a point test so that it can walk out.
+    // The hero is taken out of the grid while moving so as not to collide with itself.
+    discard(grid, id);
+    if(blocked(hero.where, hero.radius, map, *grid))
     {
-        hero.velocity = zero;
-        hero.where = last;
+        const Point last = hero.where, zero = { 0.0f, 0.0f };
+        hero.where = add(hero.where, hero.velocity);
+        if(tile(hero.where, map, WALLING))
+        {
+            hero.velocity = zero;
+            hero.where = last;
+        }
     }
+    else hero = sweep(sweep(hero, map, *grid, 0), map, *grid, 1);
+    insert(grid, id, hero.where, hero.radius);
+    return hero;
+}
+
+// Opens the wall the hero faces into a doorway, or closes the open cell the hero faces with a door,
+// unless the hero reaches into that cell. Returns true if the <map> changed.
+static bool toggle(const Hero hero, Map* const map)
+{
+    const Point reference = { 1.0f, 0.0f };
+    const Point ahead = add(hero.where, turn(reference, hero.theta));
+    const int x = fl(ahead.x);
+    const int y = fl(ahead.y);
+    const bool reached = x >= fl(hero.where.x - hero.radius) && x <= fl(hero.where.x + hero.radius)
+        && y >= fl(hero.where.y - hero.radius) && y <= fl(hero.where.y + hero.radius);
+    if(reached || (unsigned) x >= (unsigned) map->width || (unsigned) y >= (unsigned) map->height)
+        return false;
+    // Doors are blue, like the walls around the rooms of the built-in level.
+    alter(map, x, y, WALLING, cell(*map, x, y)[WALLING] ? 0 : 3);
+    return true;
+}
+
+// Advances the <hero>, filed in a spatial hash <grid> as body <id>, one simulation tick with the <keys> held and
+// <struck> during the tick. Notes in <altered> whether the <map> changed.
+static Hero step(Hero hero, Map* const map, Grid* const grid, const int id, const uint8_t* const keys,
+    const uint8_t* const struck, bool* const altered)
+{
+    hero = spin(hero, keys);
+    hero = move(hero, *map, grid, id, keys);
+    if(struck[SDL_SCANCODE_E])
+        *altered |= toggle(hero, map);
     return hero;
 }
 
-// Returns a color value (RGB) from a decimal tile value.
-static uint32_t color(const int tile)
+// Returns true if heroes <a> and <b> see the same view.
+static bool still(const Hero a, const Hero b)
 {
-    switch(tile)
+    return a.where.x == b.where.x && a.where.y == b.where.y && a.theta == b.theta
+        && a.fov.a.x == b.fov.a.x && a.fov.a.y == b.fov.a.y
+        && a.fov.b.x == b.fov.b.x && a.fov.b.y == b.fov.b.y;
+}
+
+// Returns the hero <n> of the way between the hero of the last tick <a> and the current tick <b>.
+static Hero blend(const Hero a, const Hero b, const float n)
+{
+    const Line where = { a.where, b.where };
+    Hero hero = b;
+    hero.where = lerp(where, n);
+    hero.theta = a.theta + (b.theta - a.theta) * n;
+    return hero;
+}
+
+// Opens a profiler writing a Chrome trace to <file>.
+static Profiler profile(const char* const file)
+{
+    Profiler profiler;
+    memset(&profiler, 0, sizeof(profiler));
+    profiler.file = fopen(file, "w");
+    profiler.capacity = 1 << 16;
+    profiler.events = malloc(sizeof(*profiler.events) * profiler.capacity);
+    if(profiler.file == NULL || profiler.events == NULL)
     {
-    default:
-    case 1: return 0x00AA0000; // Red.
-    case 2: return 0x0000AA00; // Green.
-    case 3: return 0x000000AA; // Blue.
+        printf("could not open %s\n", file);
+        exit(1);
     }
+    profiler.epoch = seconds();
+    // The JSON array trace format does not need the closing bracket, so the trace
+    // stays valid regardless of how the program exits.
+    fputs("[\n", profiler.file);
+    return profiler;
 }
 
-// Calculations wall size using the <corrected> ray to the wall.
-static Wall project(const int xres, const int yres, const float focal, const Point corrected)
+// Returns the name of a profiled stage.
+static const char* stage(const int s)
 {
-    // Normal distance of corrected ray is clamped to some small value else wall size will shoot to infinity.
-    const float normal = corrected.x < 1e-2f ? 1e-2f : corrected.x;
-    const float size = 0.5f * focal * xres / normal;
-    const int top = (yres + size) / 2.0f;
-    const int bot = (yres - size) / 2.0f;
-    // Top and bottom values are clamped to screen size else renderer will waste cycles
-    // (or segfault) when rasterizing pixels off screen.
-    const Wall wall = { top > yres ? yres : top, bot < 0 ? 0 : bot, size };
-    return wall;
+    static const char* const names[] = { "raycast", "floors", "walls", "ceilings", "sprites", "convert", "upload", "present" };
+    return names[s];
 }
 
-// Renders the entire scene from the <hero> perspective given a <map> and a software <gpu>.
-static void render(const Hero hero, const Map map, const Gpu gpu)
+// Writes out the events of a frame and adds them to the stage totals. Call once all threads are done.
+static void flush(Profiler* const profiler)
 {
-    const int t0 = SDL_GetTicks();
-    const Line camera = rotate(hero.fov, hero.theta);
-    const Display display = lock(gpu);
-    // Ray cast for all columns of the window.
-    for(int x = 0; x < gpu.xres; x++)
+    if(profiler == NULL)
+        return;
+    const int count = profiler->count;
+    for(int i = 0; i < count && i < profiler->capacity; i++)
     {
-        const Point direction = lerp(camera, x / (float) gpu.xres);
-        const Hit hit = cast(hero.where, direction, map.walling);
-        const Point ray = sub(hit.where, hero.where);
-        const Line trace = { hero.where, hit.where };
-        const Point corrected = turn(ray, -hero.theta);
-        const Wall wall = project(gpu.xres, gpu.yres, hero.fov.a.x, corrected);
-        // Renders flooring.
-        for(int y = 0; y < wall.bot; y++)
-            put(display, x, y, color(tile(lerp(trace, -pcast(wall.size, gpu.yres, y)), map.floring)));
-        // Renders wall.
-        for(int y = wall.bot; y < wall.top; y++)
-            put(display, x, y, color(hit.tile));
-        // Renders ceiling.
-        for(int y = wall.top; y < gpu.yres; y++)
-            put(display, x, y, color(tile(lerp(trace, +pcast(wall.size, gpu.yres, y)), map.ceiling)));
+        const Event e = profiler->events[i];
+        fprintf(profiler->file,
+            "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f},\n",
+            stage(e.stage), e.thread, 1e6 * (e.t0 - profiler->epoch), 1e6 * (e.t1 - e.t0));
+        profiler->totals[e.stage] += e.t1 - e.t0;
     }
-    unlock(gpu);
-    present(gpu);
-    // Caps frame rate to ~60 fps if the vertical sync (VSYNC) init failed.
-    const int t1 = SDL_GetTicks();
-    const int ms = 16 - (t1 - t0);
-    SDL_Delay(ms < 0 ? 0 : ms);
+    profiler->count = 0;
+    profiler->frames++;
 }
 
-static bool done()
+// Prints the average time per frame of each stage, summed over all threads.
+static void summarize(const Profiler* const profiler)
 {
-    SDL_Event event;
-    SDL_PollEvent(&event);
-    return event.type == SDL_QUIT
-        || event.key.keysym.sym == SDLK_END
-        || event.key.keysym.sym == SDLK_ESCAPE;
+    if(profiler == NULL || profiler->frames == 0)
+        return;
+    for(int i = 0; i < STAGES; i++)
+        printf("%-8s %.3f ms\n", stage(i), 1e3 * profiler->totals[i] / profiler->frames);
+    fflush(profiler->file);
 }
 
-// Changes the field of view. A focal value of 1.0 is 90 degrees.
-static Line viewport(const float focal)
+// Returns the seconds the last joined frame took to render: the longest any thread of the <pool> spent on it.
+// Unlike the time between kick() and join(), this leaves out the upload and present done in between.
+static double spent(const Pool* const pool)
 {
-    const Line fov = {
-        { focal, -1.0f },
-        { focal, +1.0f },
-    };
-    return fov;
-}
-
-static Hero born(const float focal)
-{
-    const Hero hero = {
-        viewport(focal),
-        // Where.
-        { 3.5f, 3.5f },
-        // Velocity.
-        { 0.0f, 0.0f },
-        // Speed.
-        0.10f,
-        // Acceleration.
-        0.015f,
-        // Theta radians.
-        0.0f
-    };
+    double most = 0.0;
+    for(int i = 0; i <= pool->workers; i++)
+        most = pool->spans[i] > most ? pool->spans[i] : most;
+    return most;
+}
+
+// Creates a throttle for frames of up to <xres> by <yres> taking some <target> seconds to render,
+// split between some <views>. A zero target keeps the full resolution.
+static Throttle choke(const int xres, const int yres, const double target, const int interleave, const bool indexed,
+    const bool tiled, const int views)
+{
+    Throttle throttle;
+    memset(&throttle, 0, sizeof(throttle));
+    throttle.target = target;
+    throttle.views = views;
+    for(int i = 0; i < RUNGS; i++)
+    {
+        const float scale = 1.0f - 0.1f * i;
+        const int x = xres / wide(views) * scale;
+        const int y = yres / tall(views) * scale;
+        for(int j = 0; j < views; j++)
+            throttle.cameras[i][j] = lens(x < 16 ? 16 : x, y < 16 ? 16 : y, interleave, indexed, tiled);
+    }
+    return throttle;
+}
+
+// Returns the number of pixels rendered at some <rung> of a <throttle>.
+static double pixels(const Throttle throttle, const int rung)
+{
+    return (double) throttle.cameras[rung][0].xres * throttle.cameras[rung][0].yres * throttle.views;
+}
+
+// Steps the resolution of a <throttle> down or up given the seconds the last frame <spent> rendering.
+// Render time is taken to scale with the pixel count, so the resolution only steps up when the frame time
+// predicted there is comfortably under target.
+static Throttle adapt(Throttle throttle, const double spent)
+{
+    if(throttle.target <= 0.0)
+        return throttle;
+    throttle.average = throttle.average == 0.0 ? spent : 0.9 * throttle.average + 0.1 * spent;
+    if(throttle.cooldown > 0)
+    {
+        throttle.cooldown--;
+        return throttle;
+    }
+    const int rung = throttle.rung;
+    if(throttle.average > throttle.target && rung < RUNGS - 1)
+        throttle.rung++;
+    else
+    if(rung > 0 && throttle.average * pixels(throttle, rung - 1) / pixels(throttle, rung) < 0.8 * throttle.target)
+        throttle.rung--;
+    if(throttle.rung != rung)
+    {
+        throttle.average *= pixels(throttle, throttle.rung) / pixels(throttle, rung);
+        throttle.cooldown = 15;
+    }
+    return throttle;
+}
+
+// Returns the hero of some <view> out of <views> views: the <hero> turned by as many parts of a full turn,
+// so that the views look all around the hero.
+static Hero watch(Hero hero, const int view, const int views)
+{
+    hero.theta += 2.0f * PI * view / views;
     return hero;
 }
 
-// Builds the map. Note the static prefix for the parties. Map lives in .bss in private.
-static Map build()
+// Composes the <frames> of some <views> of the scene, one from the perspective of each of the <heroes>,
+// into their portions of a <display>. Every view has its own <cameras> and <sprites>, and all share the <map>.
+static void survey(const Hero* const heroes, const int views, const Map map, const Display display, Camera* const cameras,
+    const Atlas* const atlas, Profiler* const profiler, Sprites* const sprites, Frame* const frames)
 {
-    static const char* ceiling[] = {
-        "111111111111111111111111111111111111111111111",
-        "122223223232232111111111111111222232232322321",
-        "122222221111232111111111111111222222211112321",
-        "122221221232323232323232323232222212212323231",
-        "122222221111232111111111111111222222211112321",
-        "122223223232232111111111111111222232232322321",
-        "111111111111111111111111111111111111111111111",
-    };
-    static const char* walling[] = {
-        "111111111111111111111111111111111111111111111",
-        "100000000000000111111111111111000000000000001",
-        "103330001111000111111111111111033300011110001",
-        "103000000000000000000000000000030000030000001",
-        "103330001111000111111111111111033300011110001",
-        "100000000000000111111111111111000000000000001",
-        "111111111111111111111111111111111111111111111",
-    };
-    static const char* floring[] = {
-        "111111111111111111111111111111111111111111111",
-        "122223223232232111111111111111222232232322321",
-        "122222221111232111111111111111222222211112321",
-        "122222221232323323232323232323222222212323231",
-        "122222221111232111111111111111222222211112321",
-        "122223223232232111111111111111222232232322321",
-        "111111111111111111111111111111111111111111111",
-    };
-    const Map map = { ceiling, walling, floring };
-    return map;
+    for(int i = 0; i < views; i++)
+    {
+        cameras[i] = look(aim(cameras[i], heroes[i]), map, heroes[i].where);
+        sprites[i] = depict(sprites[i], cameras[i], heroes[i], map, palette());
+        frames[i] = compose(heroes[i], map, portion(display, cameras[i], i, views), cameras[i], atlas, profiler, sprites[i]);
+    }
+}
+
+// Draws some <views> of the scene from the <heroes> perspectives given a <map> into a <display> through their <cameras>.
+static void draw(const Hero* const heroes, const int views, const Map map, const Display display, Camera* const cameras,
+    const Atlas* const atlas, Profiler* const profiler, Pool* const pool, Sprites* const sprites)
+{
+    Frame frames[VIEWS];
+    survey(heroes, views, map, display, cameras, atlas, profiler, sprites, frames);
+    // Ray cast for all columns of all views.
+    raster(pool, frames, views);
+}
+
+// Renders <frame> number of some <views> of the scene from the <heroes> perspectives given a <map> and a software <gpu>.
+// With a single gpu buffer the frame is rasterised straight into the locked texture and presented.
+// With more, the frame is rasterised into a back buffer while the last frame is uploaded from the other
+// back buffer and presented, so frames reach the window one frame late.
+static void render(const Hero* const heroes, const int views, const Map map, Gpu* const gpu, const int frame, Camera* const cameras,
+    const Atlas* const atlas, Profiler* const profiler, Pool* const pool, Sprites* const sprites)
+{
+    if(gpu->buffers == 1)
+    {
+        const Display display = lock(*gpu, frame);
+        draw(heroes, views, map, display, cameras, atlas, profiler, pool, sprites);
+        gpu->areas[frame % gpu->buffers] = area(cameras[0], views);
+        double t = stamp(profiler);
+        unlock(*gpu, frame);
+        t = lap(profiler, UPLOAD, 0, t);
+        present(*gpu, frame);
+        lap(profiler, PRESENT, 0, t);
+    }
+    else
+    {
+        Frame frames[VIEWS];
+        survey(heroes, views, map, gpu->back[frame % 2], cameras, atlas, profiler, sprites, frames);
+        kick(pool, frames, views);
+        gpu->extents[frame % 2] = area(cameras[0], views);
+        if(frame > 0)
+        {
+            double t = stamp(profiler);
+            upload(gpu, frame - 1);
+            t = lap(profiler, UPLOAD, 0, t);
+            present(*gpu, frame - 1);
+            lap(profiler, PRESENT, 0, t);
+        }
+        // The calling thread helps out with rasterising once the last frame is on its way.
+        join(pool);
+    }
+    flush(profiler);
+}
+
+// Drains all events waiting into some <input>, keeping key strokes and noting requests to quit.
+// Event timestamps are in milliseconds of SDL ticks, which are taken back to seconds() time.
+static void drain(Input* const input)
+{
+    const double now = seconds();
+    const Uint32 ticks = SDL_GetTicks();
+    for(SDL_Event event; SDL_PollEvent(&event);)
+    {
+        if(event.type == SDL_QUIT)
+            input->quit = true;
+        if(event.type != SDL_KEYDOWN && event.type != SDL_KEYUP)
+            continue;
+        const bool down = event.type == SDL_KEYDOWN;
+        if(down && (event.key.keysym.sym == SDLK_END || event.key.keysym.sym == SDLK_ESCAPE))
+            input->quit = true;
+        // Key repeats change nothing.
+        if(event.key.repeat)
+            continue;
+        // Past what can wait, the oldest stroke is folded into the keys held to make room, so that
+        // after a long stall no stroke is lost, least of all a key let go.
+        if(input->count == STROKES)
+        {
+            input->down[input->strokes[0].key] = input->strokes[0].down;
+            memmove(input->strokes, input->strokes + 1, sizeof(*input->strokes) * --input->count);
+        }
+        // Events queued while draining are stamped after the ticks were read, and are as good as new.
+        const Uint32 age = event.key.timestamp > ticks ? 0 : ticks - event.key.timestamp;
+        const Stroke stroke = { now - age / 1e3, event.key.keysym.scancode, down };
+        input->strokes[input->count++] = stroke;
+    }
+}
+
+// Feeds the key strokes of some <input> that happened by the time a simulation tick ends, <until>, to the keys
+// the tick sees.
+static void feed(Input* const input, const double until)
+{
+    memcpy(input->keys, input->down, sizeof(input->keys));
+    memset(input->struck, 0, sizeof(input->struck));
+    int fed = 0;
+    for(; fed < input->count && input->strokes[fed].time <= until; fed++)
+    {
+        const Stroke stroke = input->strokes[fed];
+        input->struck[stroke.key] |= stroke.down && !input->down[stroke.key];
+        input->down[stroke.key] = stroke.down;
+        input->keys[stroke.key] |= stroke.down;
+        if(stroke.down && input->pressed == 0.0)
+            input->pressed = stroke.time;
+    }
+    input->count -= fed;
+    memmove(input->strokes, input->strokes + fed, sizeof(*input->strokes) * input->count);
+}
+
+// Notes the input to photon <latency> of some <frame> number once presented, if the frame shows a key press.
+static void photon(Latency* const latency, const int frame)
+{
+    const double pressed = latency->pressed[frame % 3];
+    if(pressed == 0.0)
+        return;
+    const double spent = seconds() - pressed;
+    latency->pressed[frame % 3] = 0.0;
+    latency->best = latency->count == 0 || spent < latency->best ? spent : latency->best;
+    latency->worst = spent > latency->worst ? spent : latency->worst;
+    latency->total += spent;
+    latency->count++;
+}
+
+// Returns <bytes> rounded up to a whole number of pages.
+static uint64_t align(const uint64_t bytes)
+{
+    return (bytes + PAGE - 1) / PAGE * PAGE;
+}
+
+// Writes <bytes> of <data> to a level file, padded with zeros to a whole number of pages.
+static bool paste(FILE* const fp, const void* const data, const uint64_t bytes)
+{
+    static const uint8_t zeros[PAGE];
+    return fwrite(data, bytes, 1, fp) == 1 && (align(bytes) == bytes || fwrite(zeros, align(bytes) - bytes, 1, fp) == 1);
+}
+
+// Writes a <map> to a level <file>. The header and every section are padded to pages so that every section
+// starts page aligned.
+static void save(const Map map, const char* const file)
+{
+    FILE* const fp = fopen(file, "wb");
+    if(fp == NULL)
+    {
+        printf("could not open %s\n", file);
+        exit(1);
+    }
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = VERSION;
+    header.width = map.width;
+    header.height = map.height;
+    header.chunk = CHUNK_BITS;
+    const size_t words = extent(map) / (CHUNK_CELLS * LAYERS);
+    const Section cells = { CELLS, map.lit ? LIT : 0, PAGE, extent(map) };
+    const Section blocks = { BLOCKS, 0, 0, words * sizeof(*map.blocks) };
+    const Section portals = { PORTALS, 0, 0, 2 * sectors(map) };
+    header.table[header.sections++] = cells;
+    if(map.blocks)
+        header.table[header.sections++] = blocks;
+    if(map.portals)
+        header.table[header.sections++] = portals;
+    for(uint32_t i = 1; i < header.sections; i++)
+        header.table[i].offset = header.table[i - 1].offset + align(header.table[i - 1].size);
+    uint8_t page[PAGE] = { 0 };
+    memcpy(page, &header, sizeof(header));
+    if(fwrite(page, sizeof(page), 1, fp) != 1 || !paste(fp, map.cells, extent(map))
+    || (map.blocks && !paste(fp, map.blocks, blocks.size))
+    || (map.portals && !paste(fp, map.portals, portals.size)))
+    {
+        printf("could not write %s\n", file);
+        exit(1);
+    }
+    fclose(fp);
+}
+
+// Returns the index of the chunk some point is in.
+static int zone(const Map map, const Point where)
+{
+    return (fl(where.y) >> CHUNK_BITS) * map.columns + (fl(where.x) >> CHUNK_BITS);
+}
+
+#ifndef _WIN32
+// Gives the kernel some <advice> on chunks <from> up to chunk <to> of a memory mapped <map>. Pages can be
+// larger than chunks, and chunks need not start on a page, so the chunks are rounded to whole pages: out
+// to read them ahead, and in to drop them, as dropping a partly covered page would drop the chunks next
+// to them with it.
+static void advise(const Map map, const int from, const int to, const int advice)
+{
+    const size_t bytes = CHUNK_CELLS * LAYERS;
+    const uintptr_t size = sysconf(_SC_PAGESIZE);
+    const uintptr_t in = advice == MADV_DONTNEED ? size - 1 : 0;
+    const uintptr_t a = ((uintptr_t) (map.cells + bytes * from) + in) / size * size;
+    const uintptr_t b = ((uintptr_t) (map.cells + bytes * to) + size - 1 - in) / size * size;
+    if(a < b && madvise((void*) a, b - a, advice) != 0)
+    {
+        puts("could not page the map");
+        exit(1);
+    }
+}
+
+// Drops chunks <from> up to chunk <to> of a memory mapped <map>, all but those edited, whose only copy is in memory.
+static void evict(const Map map, const int from, const int to)
+{
+    for(int a = from; a < to;)
+    {
+        if(map.edited && map.edited[a])
+        {
+            a++;
+            continue;
+        }
+        int b = a + 1;
+        while(b < to && !(map.edited && map.edited[b]))
+            b++;
+        advise(map, a, b, MADV_DONTNEED);
+        a = b;
+    }
+}
+#endif
+
+// Tells the kernel which chunks of a memory mapped <map> are needed once the hero moves into a new chunk:
+// the chunks within RESIDENT chunks of <where> are read ahead, and all other chunks are dropped but those edited.
+// Rays faulting in far chunks keep them only until the hero next changes chunk, so resident memory
+// stays bounded by what is seen from around the hero. Returns the chunk of <where>, which is to be
+// passed back as the <paged> chunk on the next call.
+static int page(const Map map, const Point where, const int paged)
+{
+    const int now = zone(map, where);
+    if(!map.mapped || now == paged)
+        return now;
+#ifndef _WIN32
+    const int rows = (map.height + CHUNK - 1) / CHUNK;
+    const int cx = now % map.columns;
+    const int cy = now / map.columns;
+    const int x0 = cx - RESIDENT < 0 ? 0 : cx - RESIDENT;
+    const int x1 = cx + RESIDENT >= map.columns ? map.columns - 1 : cx + RESIDENT;
+    for(int y = 0; y < rows; y++)
+    {
+        const int row = y * map.columns;
+        if(y < cy - RESIDENT || y > cy + RESIDENT)
+            evict(map, row, row + map.columns);
+        else
+        {
+            evict(map, row, row + x0);
+            evict(map, row + x1 + 1, row + map.columns);
+            advise(map, row + x0, row + x1 + 1, MADV_WILLNEED);
+        }
+    }
+#endif
+    return now;
+}
+
+// Packs the controls of some <input> held and struck during a tick into a replay word.
+static uint16_t chord(const Input* const input)
+{
+    uint16_t word = 0;
+    for(int i = 0; i < (int) (sizeof(controls) / sizeof(*controls)); i++)
+        word |= (input->keys[controls[i]] ? 1 : 0) << i | (input->struck[controls[i]] ? 1 : 0) << (8 + i);
+    return word;
+}
+
+// Unpacks a replay <word> into the keys of some <input> held and struck during a tick.
+static void play(Input* const input, const uint16_t word)
+{
+    memset(input->keys, 0, sizeof(input->keys));
+    memset(input->struck, 0, sizeof(input->struck));
+    for(int i = 0; i < (int) (sizeof(controls) / sizeof(*controls)); i++)
+    {
+        input->keys[controls[i]] = word >> i & 1;
+        input->struck[controls[i]] = word >> (8 + i) & 1;
+    }
+}
+
+// Starts recording a replay <file> of a <map> with some number of <sprites>.
+static FILE* record(const char* const file, const Map map, const int sprites)
+{
+    FILE* const fp = fopen(file, "wb");
+    Take take;
+    memset(&take, 0, sizeof(take));
+    memcpy(take.magic, reel, sizeof(reel));
+    take.version = REPLAY;
+    take.width = map.width;
+    take.height = map.height;
+    take.sprites = sprites;
+    if(fp == NULL || fwrite(&take, sizeof(take), 1, fp) != 1)
+    {
+        printf("could not write %s\n", file);
+        exit(1);
+    }
+    return fp;
+}
+
+// Records the controls of some <input> for one tick onto a replay <tape>.
+static void keep(FILE* const tape, const Input* const input)
+{
+    const uint16_t word = chord(input);
+    fwrite(&word, sizeof(word), 1, tape);
+}
+
+// Returns true if a <file> is a replay, going by its magic.
+static bool replayed(const char* const file)
+{
+    FILE* const fp = fopen(file, "rb");
+    if(fp == NULL)
+    {
+        printf("could not open %s\n", file);
+        exit(1);
+    }
+    char head[sizeof(reel)] = { 0 };
+    const bool replay = fread(head, sizeof(head), 1, fp) == 1 && memcmp(head, reel, sizeof(reel)) == 0;
+    fclose(fp);
+    return replay;
+}
+
+// Loads a replay <file> whole, checking it was recorded on a <map> like this one with as many <sprites>.
+static Replay cue(const char* const file, const Map map, const int sprites)
+{
+    FILE* const fp = fopen(file, "rb");
+    if(fp == NULL)
+    {
+        printf("could not open %s\n", file);
+        exit(1);
+    }
+    Take take;
+    if(fread(&take, sizeof(take), 1, fp) != 1 || memcmp(take.magic, reel, sizeof(reel)) != 0)
+    {
+        printf("%s is not a replay\n", file);
+        exit(1);
+    }
+    if(take.version != REPLAY)
+    {
+        printf("%s is a replay version %u, expected version %d\n", file, take.version, REPLAY);
+        exit(1);
+    }
+    if(take.width != map.width || take.height != map.height || take.sprites != sprites)
+    {
+        printf("%s was recorded on a %d by %d level with %d sprites\n", file, take.width, take.height, take.sprites);
+        exit(1);
+    }
+    const long start = ftell(fp);
+    fseek(fp, 0, SEEK_END);
+    Replay replay = { NULL, (int) ((ftell(fp) - start) / sizeof(*replay.ticks)) };
+    replay.ticks = malloc(sizeof(*replay.ticks) * (replay.count + 1));
+    if(replay.ticks == NULL)
+    {
+        puts("out of memory");
+        exit(1);
+    }
+    fseek(fp, start, SEEK_SET);
+    if(replay.count > 0 && fread(replay.ticks, sizeof(*replay.ticks), replay.count, fp) != (size_t) replay.count)
+    {
+        printf("could not read %s\n", file);
+        exit(1);
+    }
+    fclose(fp);
+    if(replay.count == 0)
+    {
+        printf("no ticks in %s\n", file);
+        exit(1);
+    }
+    return replay;
+}
+
+// Loads a camera path file. Each line holds one "x y theta" keyframe. Lines starting with # are comments.
+static Path path(const char* const file)
+{
+    FILE* const fp = fopen(file, "r");
+    if(fp == NULL)
+    {
+        printf("could not open %s\n", file);
+        exit(1);
+    }
+    Path p = { NULL, 0 };
+    int max = 0;
+    char line[256];
+    while(fgets(line, sizeof(line), fp))
+    {
+        Hero key = born(0.8f);
+        if(line[0] == '#' || sscanf(line, "%f %f %f", &key.where.x, &key.where.y, &key.theta) != 3)
+            continue;
+        if(p.count == max)
+        {
+            max = max == 0 ? 16 : 2 * max;
+            p.keys = realloc(p.keys, sizeof(*p.keys) * max);
+            if(p.keys == NULL)
+            {
+                puts("out of memory");
+                exit(1);
+            }
+        }
+        p.keys[p.count++] = key;
+    }
+    fclose(fp);
+    if(p.count == 0)
+    {
+        printf("no keyframes in %s\n", file);
+        exit(1);
+    }
+    return p;
+}
+
+// Returns the hero of <frame> of <frames> frames moving at a constant rate through the keyframes of a <path>.
+static Hero pose(const Path p, const int frame, const int frames)
+{
+    if(p.count == 1 || frames < 2)
+        return p.keys[0];
+    const float u = frame * (p.count - 1) / (float) (frames - 1);
+    const int i = fl(u) >= p.count - 1 ? p.count - 2 : fl(u);
+    const float n = u - i;
+    const Hero a = p.keys[i];
+    const Hero b = p.keys[i + 1];
+    Hero hero = a;
+    const Line where = { a.where, b.where };
+    hero.where = lerp(where, n);
+    hero.theta = a.theta + (b.theta - a.theta) * n;
+    return hero;
+}
+
+// Compares two doubles for qsort.
+static int compare(const void* const a, const void* const b)
+{
+    const double x = *(const double*) a;
+    const double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+// Renders frames along a camera path without a window and prints frame time statistics. A replay instead
+// is simulated tick by tick on the <map> with the hero filed in the <grid>, rendering the pose of every tick,
+// and ends by printing the last pose, which matches across builds that replay the same way.
+static void bench(const Args args, Map* const map, Grid* const grid, const Atlas* const atlas, Profiler* const profiler,
+    Pool* const pool, Sprites* const sprites)
+{
+    const bool replay = replayed(args.bench);
+    Path p = { NULL, 0 };
+    Replay r = { NULL, 0 };
+    if(replay)
+        r = cue(args.bench, *map, sprites[0].count);
+    else
+        p = path(args.bench);
+    const int frames = replay ? r.count : args.frames;
+    Hero hero = born(0.8f);
+    if(replay)
+        insert(grid, sprites[0].count, hero.where, hero.radius);
+    Input input;
+    memset(&input, 0, sizeof(input));
+    bool altered = false;
+    const Display display = offscreen(args.xres, args.yres);
+    Camera cameras[VIEWS];
+    for(int i = 0; i < args.views; i++)
+        cameras[i] = lens(args.xres / wide(args.views), args.yres / tall(args.views), args.interleave, args.indexed, args.tiled);
+    double* const times = malloc(sizeof(*times) * frames);
+    if(times == NULL)
+    {
+        puts("out of memory");
+        exit(1);
+    }
+    double total = 0.0;
+    int paged = -1;
+    for(int i = 0; i < frames; i++)
+    {
+        if(replay)
+        {
+            play(&input, r.ticks[i]);
+            hero = step(hero, map, grid, sprites[0].count, input.keys, input.struck, &altered);
+        }
+        else
+            hero = pose(p, i, frames);
+        paged = page(*map, hero.where, paged);
+        Hero heroes[VIEWS];
+        for(int j = 0; j < args.views; j++)
+            heroes[j] = watch(hero, j, args.views);
+        const double t0 = seconds();
+        draw(heroes, args.views, *map, display, cameras, atlas, profiler, pool, sprites);
+        const double t1 = seconds();
+        flush(profiler);
+        times[i] = t1 - t0;
+        total += times[i];
+    }
+    qsort(times, frames, sizeof(*times), compare);
+    const int p99 = (int) (0.99 * (frames - 1));
+    printf("frames %d res %dx%d threads %d\n", frames, args.xres, args.yres, pool->workers + 1);
+    printf("min %.3f ms avg %.3f ms p99 %.3f ms\n", 1e3 * times[0], 1e3 * total / frames, 1e3 * times[p99]);
+    printf("rays/sec %.0f\n", (double) cameras[0].xres * args.views * frames / total);
+    if(replay)
+        printf("replay ends at %a %a %a\n", (double) hero.where.x, (double) hero.where.y, (double) hero.theta);
+    summarize(profiler);
+}
+
+// Prints command line usage and exits.
+static void usage(const char* const name)
+{
+    printf("usage: %s [--threads N] [--trace FILE] [--fps N] [--vsync 0|1] [--buffers 1|2|3] [--textures 0|1] [--map FILE | --generate N] [--export FILE] [--skip 0|1] [--sprites N] [--lazy 0|1] [--target MS] [--interleave N] [--indexed 0|1] [--cull 0|1] [--views 1|2|4] [--latency 0|1] [--lights N] [--record FILE | --replay FILE] [--tiled 0|1] [--bench PATH | REPLAY [--frames N] [--res WxH]]\n", name);
+    exit(1);
+}
+
+// Parses command line arguments.
+static Args parse(const int argc, char* argv[])
+{
+    Args args = { SDL_GetCPUCount(), NULL, NULL, 0, true, 1, false, 600, 700, 400, NULL, 0, NULL, true, 0, false, 0.0, 1, false, true, 1, false, 0, NULL, NULL, false };
+    for(int i = 1; i < argc; i++)
+    {
+        const char* const arg = argv[i];
+        const char* const next = i + 1 < argc ? argv[i + 1] : NULL;
+        if(next == NULL)
+            usage(argv[0]);
+        if(strcmp(arg, "--threads") == 0)
+            args.threads = atoi(next);
+        else
+        if(strcmp(arg, "--bench") == 0)
+            args.bench = next;
+        else
+        if(strcmp(arg, "--trace") == 0)
+            args.trace = next;
+        else
+        if(strcmp(arg, "--fps") == 0)
+            args.fps = atoi(next);
+        else
+        if(strcmp(arg, "--vsync") == 0)
+            args.vsync = atoi(next) != 0;
+        else
+        if(strcmp(arg, "--buffers") == 0)
+            args.buffers = atoi(next);
+        else
+        if(strcmp(arg, "--textures") == 0)
+            args.textures = atoi(next) != 0;
+        else
+        if(strcmp(arg, "--frames") == 0)
+            args.frames = atoi(next);
+        else
+        if(strcmp(arg, "--res") == 0)
+        {
+            if(sscanf(next, "%dx%d", &args.xres, &args.yres) != 2)
+                usage(argv[0]);
+        }
+        else
+        if(strcmp(arg, "--map") == 0)
+            args.level = next;
+        else
+        if(strcmp(arg, "--generate") == 0)
+            args.generate = atoi(next);
+        else
+        if(strcmp(arg, "--export") == 0)
+            args.export = next;
+        else
+        if(strcmp(arg, "--skip") == 0)
+            args.skip = atoi(next) != 0;
+        else
+        if(strcmp(arg, "--sprites") == 0)
+            args.sprites = atoi(next);
+        else
+        if(strcmp(arg, "--lazy") == 0)
+            args.lazy = atoi(next) != 0;
+        else
+        if(strcmp(arg, "--target") == 0)
+            args.target = atof(next);
+        else
+        if(strcmp(arg, "--interleave") == 0)
+            args.interleave = atoi(next);
+        else
+        if(strcmp(arg, "--indexed") == 0)
+            args.indexed = atoi(next) != 0;
+        else
+        if(strcmp(arg, "--cull") == 0)
+            args.cull = atoi(next) != 0;
+        else
+        if(strcmp(arg, "--views") == 0)
+            args.views = atoi(next);
+        else
+        if(strcmp(arg, "--latency") == 0)
+            args.latency = atoi(next) != 0;
+        else
+        if(strcmp(arg, "--lights") == 0)
+            args.lights = atoi(next);
+        else
+        if(strcmp(arg, "--record") == 0)
+            args.record = next;
+        else
+        if(strcmp(arg, "--replay") == 0)
+            args.replay = next;
+        else
+        if(strcmp(arg, "--tiled") == 0)
+            args.tiled = atoi(next) != 0;
+        else
+            usage(argv[0]);
+        i++;
+    }
+    if(args.threads < 1)
+        args.threads = 1;
+    if(args.fps < 0 || args.buffers < 1 || args.buffers > 3 || args.frames < 1 || args.xres < 1 || args.yres < 1)
+        usage(argv[0]);
+    if(args.generate < 0 || (args.generate > 0 && args.level) || args.sprites < 0 || args.target < 0.0 || args.interleave < 1
+    || args.lights < 0 || (args.views != 1 && args.views != 2 && args.views != VIEWS))
+        usage(argv[0]);
+    // Textures are true color.
+    if(args.indexed && args.textures)
+        usage(argv[0]);
+    // A replay plays back in place of the keyboard, so there is nothing to record while it plays.
+    if(args.record && args.replay)
+        usage(argv[0]);
+    return args;
 }
 
 // Get Psyched!
 int main(int argc, char* argv[])
 {
-    (void) argc;
-    (void) argv;
-    const Gpu gpu = setup(700, 400, true);
-    const Map map = build();
+    const Args args = parse(argc, argv);
+    Map map = args.level ? level(args.level) : args.generate ? generate(args.generate) : build();
+    // Binary levels may come with lights baked in already.
+    if(args.lights > 0)
+        map = bake(map, args.lights);
+    if(!args.skip)
+        map.blocks = NULL;
+    else
+    if(map.blocks == NULL)
+        map = occupy(map);
+    if(!args.cull)
+        map.portals = NULL;
+    else
+    if(map.portals == NULL)
+        map = graph(map);
+    if(args.export)
+    {
+        save(map, args.export);
+        return 0;
+    }
+    palette();
+    spectrum();
+    colormap();
+#ifdef FIXED
+    sines();
+#endif
+    Pool pool = spawn(args.threads);
+    start(&pool);
+    Profiler trace;
+    if(args.trace)
+        trace = profile(args.trace);
+    Profiler* const profiler = args.trace ? &trace : NULL;
+    Atlas textures;
+    if(args.textures)
+        textures = atlas(16, 6);
+    const Atlas* const a = args.textures ? &textures : NULL;
+    Sprites sprites = scatter(map, args.sprites, born(0.8f).where);
+    // The hero is the last body of the grid.
+    Grid grid = crowd(sprites, 1);
+    // Every view sees the same sprites, but sorts its own billboards.
+    Sprites views[VIEWS];
+    for(int i = 0; i < args.views; i++)
+        views[i] = i > 0 && sprites.count > 0 ? share(sprites, sprites.count) : sprites;
+    if(args.bench)
+    {
+        bench(args, &map, &grid, a, profiler, &pool, views);
+        return 0;
+    }
+    Gpu gpu = setup(700, 400, args.vsync, args.buffers);
+    Throttle throttle = choke(gpu.xres, gpu.yres, args.target / 1e3, args.interleave, args.indexed, args.tiled, args.views);
     Hero hero = born(0.8f);
-    while(!done())
+    Hero last = hero;
+    insert(&grid, sprites.count, hero.where, hero.radius);
+    int paged = page(map, hero.where, -1);
+    // The game simulates at a fixed tick rate while rendering runs as fast as vsync or --fps allow.
+    // Rendered frames blend the last two ticks.
+    const double tick = 1.0 / 60.0;
+    double then = seconds();
+    double lag = 0.0;
+    // Frames rendered so far, which also picks the textures and back buffers to use.
+    int frame = 0;
+    // The pose of the last rendered frame, whether that frame is still waiting in a back buffer,
+    // and whether the map changed since.
+    Hero shown = hero;
+    bool pending = false;
+    bool altered = false;
+    Input input;
+    memset(&input, 0, sizeof(input));
+    Latency latency;
+    memset(&latency, 0, sizeof(latency));
+    FILE* const tape = args.record ? record(args.record, map, sprites.count) : NULL;
+    Replay replay = { NULL, 0 };
+    if(args.replay)
+        replay = cue(args.replay, map, sprites.count);
+    int played = 0;
+    for(;;)
+    {
+        drain(&input);
+        if(input.quit)
+            break;
+        const double now = seconds();
+        // Lag is capped so a long stall does not have to be simulated back in one go.
+        lag += now - then;
+        lag = lag > 0.25 ? 0.25 : lag;
+        then = now;
+        // Every tick sees the keys as they were over its own span of time, which ends where the lag left over begins.
+        for(; lag >= tick; lag -= tick)
+        {
+            feed(&input, now - lag + tick);
+            // Playback replaces the keys of every tick until the replay runs out.
+            if(args.replay)
+            {
+                if(played == replay.count)
+                {
+                    input.quit = true;
+                    break;
+                }
+                play(&input, replay.ticks[played++]);
+            }
+            if(tape)
+                keep(tape, &input);
+            last = hero;
+            hero = step(hero, &map, &grid, sprites.count, input.keys, input.struck, &altered);
+            paged = page(map, hero.where, paged);
+        }
+        const Hero pose = blend(last, hero, lag / tick);
+        // In lazy mode an unchanged pose presents the last frame again, without rendering,
+        // or presents nothing at all while the window cannot be seen, until the next tick.
+        if(args.lazy && frame > 0 && !altered && still(pose, shown))
+        {
+            if(!hidden(gpu))
+            {
+                if(pending)
+                    upload(&gpu, frame - 1);
+                pending = false;
+                present(gpu, frame - 1);
+                photon(&latency, frame - 1);
+            }
+            // A press that changes nothing never shows.
+            input.pressed = 0.0;
+            const double left = tick - lag - (seconds() - now);
+            if(left > 0.0)
+                SDL_Delay(1e3 * left);
+            continue;
+        }
+        Hero heroes[VIEWS];
+        for(int i = 0; i < args.views; i++)
+            heroes[i] = watch(pose, i, args.views);
+        latency.pressed[frame % 3] = input.pressed;
+        input.pressed = 0.0;
+        render(heroes, args.views, map, &gpu, frame++, throttle.cameras[throttle.rung], a, profiler, &pool, views);
+        if(gpu.buffers == 1 || frame > 1)
+            photon(&latency, gpu.buffers == 1 ? frame - 1 : frame - 2);
+        throttle = adapt(throttle, spent(&pool));
+        shown = pose;
+        pending = gpu.buffers > 1;
+        altered = false;
+        // Sleeps off what is left of the frame at the target frame rate.
+        if(args.fps > 0)
+        {
+            const double left = 1.0 / args.fps - (seconds() - now);
+            if(left > 0.0)
+                SDL_Delay(1e3 * left);
+        }
+    }
+    if(tape && fclose(tape) != 0)
     {
-        const uint8_t* key = SDL_GetKeyboardState(NULL);
-        hero = spin(hero, key);
-        hero = move(hero, map.walling, key);
-        render(hero, map, gpu);
+        printf("could not write %s\n", args.record);
+        exit(1);
     }
+    summarize(profiler);
+    if(args.latency && latency.count > 0)
+        printf("latency min %.1f avg %.1f max %.1f ms over %d presses\n",
+            1e3 * latency.best, 1e3 * latency.total / latency.count, 1e3 * latency.worst, latency.count);
     // No need to free anything - gives quick exit.
     return 0;
 }
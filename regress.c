@@ -0,0 +1,357 @@
+// Regression checks of the renderer. Renders a fixed set of poses over a few built-in maps, in every render mode
+// worth guarding, and checks the hash of every frame against golden values, so that no optimisation changes
+// a pixel unnoticed. Also times the cases and checks their median frame times against a stored baseline.
+// Needs no SDL: the engine is included whole like the game includes it.
+
+#include "littlewolf.c"
+
+// Poses rendered per case, and the resolution they are rendered at.
+enum
+{
+    POSES = 16,
+    // The lone pillar stands a few cells in front of the north wall of an open map of LONE cells a side.
+    LONE = 128,
+    STAND = LONE - 4,
+    XRES = 320,
+    YRES = 200
+};
+
+// A case of the check renders one of the <maps> in some render mode.
+typedef struct
+{
+    const char* name;
+    int map;
+    bool textured;
+    bool indexed;
+    int interleave;
+    bool skip;
+    bool cull;
+    bool tiled;
+}
+Case;
+
+static const Case cases[] = {
+    { "built-flat", 0, false, false, 1, true, true, false },
+    { "built-textured", 0, true, false, 1, true, true, false },
+    { "built-indexed", 0, false, true, 1, true, true, false },
+    { "pillars-flat", 1, false, false, 1, true, true, false },
+    { "pillars-interleaved", 1, false, false, 4, true, true, false },
+    { "pillars-noskip-nocull", 1, false, false, 1, false, false, false },
+    { "pillars-textured", 1, true, false, 1, true, true, false },
+    { "pillars-tiled", 1, true, false, 1, true, true, true },
+    { "lit-flat", 2, false, false, 1, true, true, false },
+    { "lit-textured", 2, true, false, 1, true, true, false },
+    { "lit-indexed", 2, false, true, 4, true, true, false },
+    { "lit-tiled", 2, false, true, 4, true, true, true },
+    { "lone-flat", 3, false, false, 1, true, true, false },
+    { "lone-interleaved", 3, false, false, 16, true, true, false },
+};
+
+// The maps of the cases, each with the sprites scattered over it. The <lone> pillar is posed apart.
+typedef struct
+{
+    Map map;
+    Sprites sprites;
+    bool lone;
+}
+Scene;
+
+typedef struct
+{
+    const char* hashes;
+    const char* times;
+    bool update;
+    double threshold;
+    int repeats;
+    int threads;
+}
+Args;
+
+// Returns an open map with one pillar standing in front of its north wall.
+static Map lone()
+{
+    const Map map = blank(LONE, LONE);
+    for(int y = 0; y < LONE; y++)
+    for(int x = 0; x < LONE; x++)
+    {
+        uint8_t* const c = site(map, x, y);
+        const bool edge = x == 0 || y == 0 || x == LONE - 1 || y == LONE - 1;
+        c[CEILING] = 1;
+        c[WALLING] = edge || (x == LONE / 2 && y == STAND) ? 2 : 0;
+        c[FLORING] = 3;
+    }
+    return map;
+}
+
+// Returns the scene of map number <i>: the built-in level, a generated level of pillars, the same lit,
+// and a lone pillar without sprites.
+static Scene scene(const int i)
+{
+    Map map = i == 0 ? build() : i == 3 ? lone() : generate(256);
+    if(i == 2)
+        map = bake(map, 200);
+    map = graph(occupy(map));
+    const Scene s = { map, scatter(map, i == 0 ? 8 : i == 3 ? 0 : 400, born(0.8f).where), i == 3 };
+    return s;
+}
+
+// Returns pose <i> of the lone pillar: further south pose by pose, so that it is ever narrower on screen
+// against the wall behind it, and some hashed way off the middle of the view, so that it falls anywhere
+// between the cast columns.
+static Hero far(const int i)
+{
+    Hero hero = born(0.8f);
+    const uint32_t a = noise(0x10E + i);
+    const float distance = 4.0f + 6.0f * i + (a & 0xFF) / 256.0f;
+    hero.where.x = LONE / 2 + 0.5f + 0.3f * distance * ((a >> 8 & 0x3FF) / 512.0f - 1.0f);
+    hero.where.y = STAND + 0.5f - distance;
+    hero.theta = PI / 2 + 0.8f * ((a >> 18 & 0x3FF) / 1024.0f - 0.5f);
+    return hero;
+}
+
+// Returns pose <i> of a <scene>: in an open cell picked by hashing, looking some hashed way into another open cell.
+static Hero place(const Scene s, const int i)
+{
+    if(s.lone)
+        return far(i);
+    const Map map = s.map;
+    Hero hero = born(0.8f);
+    for(uint32_t n = 0;; n++)
+    {
+        const uint32_t a = noise(0x5EED + 64 * i + 2 * n);
+        const uint32_t b = noise(0x5EED + 64 * i + 2 * n + 1);
+        const int x = a % map.width;
+        const int y = b % map.height;
+        if(!vacant(map, x, y))
+            continue;
+        hero.where.x = x + 0.25f + 0.5f * (a >> 22) / 1024.0f;
+        hero.where.y = y + 0.25f + 0.5f * (b >> 22) / 1024.0f;
+        hero.theta = 2.0f * PI * (a >> 8 & 0x3FF) / 1024.0f;
+        // Poses up against a wall see nothing but the wall.
+        if(!vacant(map, fl(hero.where.x + cosf(hero.theta)), fl(hero.where.y + sinf(hero.theta))))
+            continue;
+        return hero;
+    }
+}
+
+// FNV-1a hash of the <xres> by <yres> pixels of a <display>.
+static uint64_t digest(const Display display, const int xres, const int yres)
+{
+    uint64_t h = 14695981039346656037u;
+    for(int x = 0; x < xres; x++)
+    for(int y = 0; y < yres; y++)
+    {
+        h ^= display.pixels[x * display.width + y] & 0x00FFFFFF;
+        h *= 1099511628211u;
+    }
+    return h;
+}
+
+// Renders one pose of a <scene> in the mode of some case <c> onto a <display>.
+static void shoot(const Case c, const Scene s, const Hero hero, Camera* const camera, Sprites* const sprites,
+    const Display display, const Atlas* const atlas, Pool* const pool)
+{
+    Map map = s.map;
+    if(!c.skip)
+        map.blocks = NULL;
+    if(!c.cull)
+        map.portals = NULL;
+    *camera = look(aim(*camera, hero), map, hero.where);
+    *sprites = depict(*sprites, *camera, hero, map, palette());
+    const Frame frame = compose(hero, map, display, *camera, c.textured ? atlas : NULL, NULL, *sprites);
+    raster(pool, &frame, 1);
+}
+
+// Compares two doubles for qsort.
+static int compare(const void* const a, const void* const b)
+{
+    const double x = *(const double*) a;
+    const double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+// Looks up the value stored for some <name> and <pose> in the lines of a golden or baseline <file>, which are
+// a name, a pose number and a value each. Returns false if there is none.
+static bool recall(FILE* const file, const char* const name, const int pose, char value[32])
+{
+    if(file == NULL)
+        return false;
+    rewind(file);
+    char line[256];
+    while(fgets(line, sizeof(line), file))
+    {
+        char key[64];
+        int i;
+        if(line[0] != '#' && sscanf(line, "%63s %d %31s", key, &i, value) == 3 && strcmp(key, name) == 0 && i == pose)
+            return true;
+    }
+    return false;
+}
+
+// Prints command line usage and exits.
+static void usage(const char* const name)
+{
+    printf("usage: %s [--hashes FILE] [--times FILE [--threshold PERCENT] [--repeats N]] [--update 0|1] [--threads N]\n", name);
+    exit(1);
+}
+
+static Args parse(const int argc, char* argv[])
+{
+#ifdef _WIN32
+    const int cpus = 4;
+#else
+    const int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    Args args = { NULL, NULL, false, 10.0, 20, cpus < 1 ? 1 : cpus };
+    for(int i = 1; i < argc; i++)
+    {
+        const char* const arg = argv[i];
+        const char* const next = i + 1 < argc ? argv[i + 1] : NULL;
+        if(next == NULL)
+            usage(argv[0]);
+        if(strcmp(arg, "--hashes") == 0)
+            args.hashes = next;
+        else
+        if(strcmp(arg, "--times") == 0)
+            args.times = next;
+        else
+        if(strcmp(arg, "--threshold") == 0)
+            args.threshold = atof(next);
+        else
+        if(strcmp(arg, "--repeats") == 0)
+            args.repeats = atoi(next);
+        else
+        if(strcmp(arg, "--update") == 0)
+            args.update = atoi(next) != 0;
+        else
+        if(strcmp(arg, "--threads") == 0)
+            args.threads = atoi(next);
+        else
+            usage(argv[0]);
+        i++;
+    }
+    if((args.hashes == NULL && args.times == NULL) || args.threshold < 0.0 || args.repeats < 1 || args.threads < 1)
+        usage(argv[0]);
+    return args;
+}
+
+// Opens a golden or baseline <file> to read it, or to write it anew when updating. A missing file reads as empty.
+static FILE* store(const char* const file, const bool update)
+{
+    if(file == NULL)
+        return NULL;
+    FILE* const fp = fopen(file, update ? "w" : "r");
+    if(fp == NULL && update)
+    {
+        printf("could not write %s\n", file);
+        exit(1);
+    }
+    if(fp && update)
+        fputs("# Written by regress --update 1: a case, a pose and a value a line.\n", fp);
+    return fp;
+}
+
+int main(int argc, char* argv[])
+{
+    const Args args = parse(argc, argv);
+    palette();
+    spectrum();
+    colormap();
+#ifdef FIXED
+    sines();
+#endif
+    Pool pool = spawn(args.threads);
+    start(&pool);
+    const Atlas textures = atlas(16, 6);
+    Scene scenes[4];
+    for(int i = 0; i < 4; i++)
+        scenes[i] = scene(i);
+    Display display = { calloc((size_t) XRES * YRES, sizeof(uint32_t)), YRES };
+    double* const times = malloc(sizeof(*times) * POSES * args.repeats);
+    if(display.pixels == NULL || times == NULL)
+    {
+        puts("out of memory");
+        exit(1);
+    }
+    FILE* const hashes = store(args.hashes, args.update);
+    FILE* const baseline = store(args.times, args.update);
+    int failures = 0;
+    for(int i = 0; i < (int) (sizeof(cases) / sizeof(*cases)); i++)
+    {
+        const Case c = cases[i];
+        const Scene s = scenes[c.map];
+        Camera camera = lens(XRES, YRES, c.interleave, c.indexed, c.tiled);
+        Sprites sprites = share(s.sprites, s.sprites.count);
+        int wrong = 0;
+        for(int j = 0; args.hashes && j < POSES; j++)
+        {
+            shoot(c, s, place(s, j), &camera, &sprites, display, &textures, &pool);
+            const uint64_t hash = digest(display, XRES, YRES);
+            char golden[32];
+            char found[32];
+            snprintf(found, sizeof(found), "%016llx", (unsigned long long) hash);
+            if(args.update)
+                fprintf(hashes, "%s %d %s\n", c.name, j, found);
+            else
+            if(!recall(hashes, c.name, j, golden) || strcmp(golden, found) != 0)
+            {
+                printf("%s pose %d hash %s, expected %s\n", c.name, j, found, recall(hashes, c.name, j, golden) ? golden : "none");
+                wrong++;
+            }
+        }
+        if(args.hashes)
+            printf("%s %s\n", args.update ? "hashed" : wrong ? "FAIL" : "ok", c.name);
+        bool failed = wrong > 0;
+        if(args.times == NULL)
+        {
+            failures += failed;
+            continue;
+        }
+        // Every pose is rendered once first to warm the caches.
+        for(int j = 0; j < POSES; j++)
+            shoot(c, s, place(s, j), &camera, &sprites, display, &textures, &pool);
+        for(int k = 0; k < args.repeats; k++)
+        for(int j = 0; j < POSES; j++)
+        {
+            const double t0 = seconds();
+            shoot(c, s, place(s, j), &camera, &sprites, display, &textures, &pool);
+            times[k * POSES + j] = seconds() - t0;
+        }
+        qsort(times, POSES * args.repeats, sizeof(*times), compare);
+        const double median = 1e3 * times[POSES * args.repeats / 2];
+        char stored[32];
+        if(args.update)
+        {
+            fprintf(baseline, "%s 0 %.4f\n", c.name, median);
+            printf("timed %s median %.4f ms\n", c.name, median);
+        }
+        else
+        if(!recall(baseline, c.name, 0, stored))
+            printf("new %s median %.4f ms, no baseline\n", c.name, median);
+        else
+        {
+            const double limit = atof(stored) * (1.0 + args.threshold / 100.0);
+            const bool slow = median > limit;
+            printf("%s %s median %.4f ms, baseline %s ms\n", slow ? "SLOW" : "ok", c.name, median, stored);
+            failed |= slow;
+        }
+        failures += failed;
+    }
+    if(args.update)
+    {
+        if((hashes && fclose(hashes) != 0) || (baseline && fclose(baseline) != 0))
+        {
+            puts("could not write results");
+            exit(1);
+        }
+        return 0;
+    }
+    if(failures)
+    {
+        printf("%d of %d cases failed\n", failures, (int) (sizeof(cases) / sizeof(*cases)));
+        exit(1);
+    }
+    puts("all cases passed");
+    // No need to free anything - gives quick exit.
+    return 0;
+}